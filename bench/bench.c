@@ -0,0 +1,545 @@
+// bench.c - time the engine's kernels on synthetic signals, and whole renders (analysis
+// and synthesis) of generated sweeps and the bundled samples. Every result is given
+// as ns per frame and as a realtime factor, and can be saved as JSON and compared
+// against an earlier run's file.
+//
+// Usage: bench/bench [--quick] [--json results.json] [--compare baseline.json] [sample.wav ...]
+//        (default samples: samples/*.wav)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../src/whistler.h"
+
+#define BENCH_RATE 44100            // Sample rate of the synthetic signals
+#define BENCH_FRAMES BENCH_RATE     // Frames of audio per kernel iteration (one second)
+#define BENCH_MIN_SECONDS 0.25      // Each trial repeats its work for at least this long
+#define BENCH_QUICK_SECONDS 0.05    // ... or this long with --quick
+#define BENCH_TRIALS 3              // Trials per benchmark; the fastest counts
+#define BENCH_SWEEP_SECONDS 20      // Length of the generated sweeps
+#define BENCH_MAX_RESULTS 256
+#define BENCH_TOLERANCE 0.10        // Slower than the baseline by more than this gets flagged
+
+typedef struct {
+    char name[64];
+    double ns_per_frame;
+    double realtime;
+} BenchResult;
+
+// One benchmark: run(ctx) processes `frames` frames of audio at `samplerate`
+typedef struct {
+    const char *name;
+    void (*run)(void *ctx);
+    void *ctx;
+    sf_count_t frames;
+    int samplerate;
+} Bench;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int num_results = 0;
+static BenchResult baseline[BENCH_MAX_RESULTS];
+static int num_baseline = 0;
+static double min_seconds = BENCH_MIN_SECONDS;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// A harmonic tone gliding from f0 to f1 with a little noise, like a whistle
+static void make_glide(float *signal, sf_count_t frames, int channels, int samplerate, float f0, float f1) {
+    double phase = 0.0;
+    srand(1234);
+    for (sf_count_t i = 0; i < frames; i++) {
+        float t = (float)i / frames;
+        phase += 2.0 * M_PI * (f0 * powf(f1 / f0, t)) / samplerate;
+        float noise = ((float)rand() / RAND_MAX - 0.5f) * 0.02f;
+        float value = 0.3f * (float)sin(phase) + 0.12f * (float)sin(2 * phase) +
+                      0.06f * (float)sin(3 * phase) + noise;
+        for (int ch = 0; ch < channels; ch++) {
+            signal[i * channels + ch] = value;
+        }
+    }
+}
+
+// Find how many runs fill the minimum time, then time that many runs a few times over
+static void run_bench(const Bench *bench) {
+    bench->run(bench->ctx);  // Warm up caches, tables and plans
+
+    int repeats = 1;
+    for (;;) {
+        double start = now_seconds();
+        for (int r = 0; r < repeats; r++) bench->run(bench->ctx);
+        if (now_seconds() - start >= min_seconds / 4 || repeats >= 1 << 20) break;
+        repeats *= 2;
+    }
+
+    double best = 1e30;
+    for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+        int runs = 0;
+        double start = now_seconds();
+        double elapsed;
+        do {
+            for (int r = 0; r < repeats; r++) bench->run(bench->ctx);
+            runs += repeats;
+            elapsed = now_seconds() - start;
+        } while (elapsed < min_seconds);
+        if (elapsed / runs < best) best = elapsed / runs;
+    }
+
+    BenchResult *result = &results[num_results < BENCH_MAX_RESULTS ? num_results++ : BENCH_MAX_RESULTS - 1];
+    snprintf(result->name, sizeof(result->name), "%s", bench->name);
+    result->ns_per_frame = best * 1e9 / bench->frames;
+    result->realtime = (double)bench->frames / bench->samplerate / best;
+
+    printf("  %-34s %10.2f ns/frame %10.1fx realtime", result->name, result->ns_per_frame, result->realtime);
+    for (int b = 0; b < num_baseline; b++) {
+        if (strcmp(baseline[b].name, result->name) != 0) continue;
+        double speedup = baseline[b].ns_per_frame / result->ns_per_frame;
+        printf("  %5.2fx vs baseline%s", speedup, speedup < 1.0 - BENCH_TOLERANCE ? "  <-- slower" : "");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// Pitch analysis: one engine over every hop window of a glide
+typedef struct {
+    const PitchEngine *engine;
+    void *state;
+    const float *signal;
+    int num_windows;
+    FrequencyPoint *peaks;
+} AnalysisBench;
+
+static void run_analysis(void *ctx) {
+    AnalysisBench *b = (AnalysisBench*)ctx;
+    int after = BENCH_FRAMES - ((b->num_windows - 1) * HOP_SIZE + WINDOW_SIZE);
+    b->engine->analyze(b->state, b->signal, 1, HOP_SIZE, b->num_windows, 0, after, b->peaks);
+}
+
+// The waveform function the wavetables are sampled from, over a second of phases
+typedef struct {
+    int instrument;
+    float sink;
+} WaveBench;
+
+static void run_wave(void *ctx) {
+    WaveBench *b = (WaveBench*)ctx;
+    const InstrumentPreset *preset = &presets[b->instrument];
+    float sum = 0.0f;
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        float x = (float)(i % 441) / 441.0f;  // 100 Hz
+        sum += instrument_wave(x, b->instrument, preset->wave_blend, preset->brightness, preset->harmonics);
+    }
+    b->sink += sum;
+}
+
+// The synth (controls, oscillator bank and chorus) over a second of a pitch track
+typedef struct {
+    int instrument;
+    OscBankKernel kernel;
+    const FrequencyPoint *points;
+    int num_windows;
+    float *out;
+} SynthBench;
+
+static void run_synth(void *ctx) {
+    SynthBench *b = (SynthBench*)ctx;
+    Synth synth;
+    if (synth_init(&synth, b->instrument, b->points, b->num_windows, BENCH_FRAMES, BENCH_RATE, 1.0f,
+                   b->kernel, CONTROL_BLOCK)) {
+        fprintf(stderr, "Error: Could not set up the synth\n");
+        exit(1);
+    }
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        synth_render(&synth, b->out + done, frames);
+    }
+    synth_free(&synth);
+}
+
+// A block-at-a-time effect over a second of stereo (or mono) input. The input is
+// copied in fresh each run so the signal never decays into denormals.
+typedef struct {
+    int channels;
+    const float *input;
+    float *buffer;
+    float *out;
+    float *delay;           // Chorus delay per frame
+    Reverb *reverb;
+    Chorus chorus;
+    Echo echo;
+    Limiter limiter;
+    Resampler resampler;
+} EffectBench;
+
+static void run_reverb(void *ctx) {
+    EffectBench *b = (EffectBench*)ctx;
+    memcpy(b->buffer, b->input, sizeof(float) * BENCH_FRAMES * b->channels);
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        apply_reverb(b->reverb, b->buffer + (sf_count_t)done * b->channels, frames, b->channels);
+    }
+}
+
+// The synth runs the chorus a sub-block at a time, so the bench does too
+static void run_chorus(void *ctx) {
+    EffectBench *b = (EffectBench*)ctx;
+    memcpy(b->buffer, b->input, sizeof(float) * BENCH_FRAMES);
+    for (int done = 0; done < BENCH_FRAMES; done += SYNTH_BLOCK) {
+        int frames = BENCH_FRAMES - done < SYNTH_BLOCK ? BENCH_FRAMES - done : SYNTH_BLOCK;
+        chorus_process(&b->chorus, b->buffer + done, b->delay + done, frames);
+    }
+}
+
+static void run_echo(void *ctx) {
+    EffectBench *b = (EffectBench*)ctx;
+    memcpy(b->buffer, b->input, sizeof(float) * BENCH_FRAMES * b->channels);
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        echo_process(&b->echo, b->buffer + (sf_count_t)done * b->channels, frames);
+    }
+}
+
+static void run_limiter(void *ctx) {
+    EffectBench *b = (EffectBench*)ctx;
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        limiter_process(&b->limiter, b->input + (sf_count_t)done * b->channels, b->out, frames);
+    }
+}
+
+static void run_resample(void *ctx) {
+    EffectBench *b = (EffectBench*)ctx;
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        resampler_process(&b->resampler, b->input + (sf_count_t)done * b->channels, frames, b->out);
+    }
+}
+
+// Summing a track onto the mix bus, a block at a time as chorus does
+typedef struct {
+    int track_channels;
+    const float *track;
+    float *bus;             // Stereo
+} MixBench;
+
+static void run_mix(void *ctx) {
+    MixBench *b = (MixBench*)ctx;
+    memset(b->bus, 0, sizeof(float) * BENCH_FRAMES * 2);
+    for (int done = 0; done < BENCH_FRAMES; done += STREAM_BLOCK) {
+        int frames = BENCH_FRAMES - done < STREAM_BLOCK ? BENCH_FRAMES - done : STREAM_BLOCK;
+        mix_block_add(b->bus + (sf_count_t)done * 2, 2, b->track + (sf_count_t)done * b->track_channels,
+                      b->track_channels, frames, 0.5f);
+    }
+}
+
+// A whole render as whistler does it: analyse the file (no pitch track sidecar),
+// then synthesize and reverb every block. The engine's messages are hidden.
+typedef struct {
+    const char *path;
+    RenderOptions options;
+    float *block;
+} RenderBench;
+
+static void run_render(void *ctx) {
+    RenderBench *b = (RenderBench*)ctx;
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    PitchTrack track;
+    Renderer renderer;
+    int failed = pitch_track_analyze(b->path, &b->options, &track);
+    if (!failed) {
+        failed = renderer_init(&renderer, &track, &b->options);
+        while (!failed && renderer_render(&renderer, b->block, STREAM_BLOCK) > 0) {}
+        if (!failed) renderer_free(&renderer);
+        pitch_track_free(&track);
+    }
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (failed) {
+        fprintf(stderr, "Error: Could not render %s\n", b->path);
+        exit(1);
+    }
+}
+
+static void bench_render(const char *name, const char *path) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE *file = sf_open(path, SFM_READ, &info);
+    if (!file || info.frames < WINDOW_SIZE) {
+        fprintf(stderr, "Skipping %s\n", path);
+        if (file) sf_close(file);
+        return;
+    }
+    sf_close(file);
+
+    RenderBench render;
+    render.path = path;
+    render_options_init(&render.options);
+    render.options.pitch_cache = 0;
+    render.block = (float*)malloc(sizeof(float) * STREAM_BLOCK * info.channels);
+    char label[64];
+    snprintf(label, sizeof(label), "render/%s", name);
+    Bench bench = {label, run_render, &render, info.frames, info.samplerate};
+    run_bench(&bench);
+    free(render.block);
+}
+
+// Write a generated sweep to a WAV for the end-to-end renders
+static int write_sweep(const char *path, int channels, int samplerate, int format) {
+    sf_count_t frames = (sf_count_t)BENCH_SWEEP_SECONDS * samplerate;
+    float *signal = (float*)malloc(sizeof(float) * frames * channels);
+    if (!signal) return 1;
+    make_glide(signal, frames, channels, samplerate, 220.0f, 1200.0f);
+
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    info.samplerate = samplerate;
+    info.channels = channels;
+    info.format = SF_FORMAT_WAV | format;
+    SNDFILE *file = sf_open(path, SFM_WRITE, &info);
+    int failed = !file || sf_writef_float(file, signal, frames) != frames;
+    if (file) sf_close(file);
+    free(signal);
+    return failed;
+}
+
+// Read a results file written by --json (one result per line, as written below)
+static int read_baseline(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return 1;
+    char line[512];
+    while (fgets(line, sizeof(line), file) && num_baseline < BENCH_MAX_RESULTS) {
+        BenchResult *result = &baseline[num_baseline];
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"ns_per_frame\": %lf, \"realtime\": %lf",
+                   result->name, &result->ns_per_frame, &result->realtime) == 3) {
+            num_baseline++;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int write_results(const char *path, const char *kernel) {
+    FILE *file = fopen(path, "w");
+    if (!file) return 1;
+    fprintf(file, "{\n  \"engine_version\": %d,\n  \"kernel\": \"%s\",\n  \"threads\": %d,\n",
+            WHISTLER_ENGINE_VERSION, kernel, default_thread_count());
+    fprintf(file, "  \"results\": [\n");
+    for (int r = 0; r < num_results; r++) {
+        fprintf(file, "    {\"name\": \"%s\", \"ns_per_frame\": %.4f, \"realtime\": %.2f}%s\n",
+                results[r].name, results[r].ns_per_frame, results[r].realtime, r == num_results - 1 ? "" : ",");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) != 0;
+}
+
+static const char *best_kernel_name(void) {
+    OscBankKernel best = osc_bank_select("auto");
+    for (int k = 0; k < NUM_OSC_BANK_KERNELS; k++) {
+        if (osc_bank_select(osc_bank_kernel_names[k]) == best) return osc_bank_kernel_names[k];
+    }
+    return "unknown";
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_file = NULL;
+    const char *compare_file = NULL;
+    char **files = (char**)malloc(sizeof(char*) * (argc > 1 ? argc : 1));
+    int num_files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            min_seconds = BENCH_QUICK_SECONDS;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_file = argv[++i];
+        } else {
+            files[num_files++] = argv[i];
+        }
+    }
+    if (compare_file && read_baseline(compare_file)) {
+        fprintf(stderr, "Error: Could not read %s\n", compare_file);
+        return 1;
+    }
+    if (num_baseline > 0) {
+        printf("Comparing against %s\n", compare_file);
+    }
+
+    // Shared synthetic input: a second of glide, mono and stereo, and a pitch
+    // track that glides across it
+    float *mono = (float*)malloc(sizeof(float) * BENCH_FRAMES);
+    float *stereo = (float*)malloc(sizeof(float) * BENCH_FRAMES * 2);
+    float *buffer = (float*)malloc(sizeof(float) * BENCH_FRAMES * 2);
+    float *out = (float*)malloc(sizeof(float) * (BENCH_FRAMES + STREAM_BLOCK) * 2);
+    float *delay = (float*)malloc(sizeof(float) * BENCH_FRAMES);
+    int num_windows = (BENCH_FRAMES - WINDOW_SIZE) / HOP_SIZE + 1;
+    FrequencyPoint *points = (FrequencyPoint*)malloc(sizeof(FrequencyPoint) * num_windows);
+    if (!mono || !stereo || !buffer || !out || !delay || !points) {
+        fprintf(stderr, "Error: Could not allocate memory\n");
+        return 1;
+    }
+    make_glide(mono, BENCH_FRAMES, 1, BENCH_RATE, 220.0f, 1200.0f);
+    make_glide(stereo, BENCH_FRAMES, 2, BENCH_RATE, 220.0f, 1200.0f);
+    for (int w = 0; w < num_windows; w++) {
+        points[w].frequency = 220.0f * powf(1200.0f / 220.0f, (float)w / num_windows);
+        points[w].amplitude = 0.5f;
+    }
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        delay[i] = (CHORUS_DELAY + CHORUS_SWEEP * sinf(2.0f * M_PI * CHORUS_RATE * i / BENCH_RATE)) * BENCH_RATE;
+    }
+
+    printf("Kernels (%d Hz, one second of audio per run; oscillator kernel: %s)\n", BENCH_RATE, best_kernel_name());
+    char name[64];
+    for (int e = 0; e < num_pitch_engines; e++) {
+        AnalysisBench analysis = {&pitch_engines[e], NULL, mono, num_windows, points};
+        analysis.peaks = (FrequencyPoint*)malloc(sizeof(FrequencyPoint) * num_windows);
+        analysis.state = pitch_engines[e].create(BENCH_RATE, ANALYSIS_BATCH, FFTW_ESTIMATE);
+        if (!analysis.peaks || !analysis.state) {
+            fprintf(stderr, "Error: Could not set up the %s engine\n", pitch_engines[e].name);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "analysis/%s", pitch_engines[e].name);
+        Bench bench = {name, run_analysis, &analysis, BENCH_FRAMES, BENCH_RATE};
+        run_bench(&bench);
+        pitch_engines[e].destroy(analysis.state);
+        free(analysis.peaks);
+    }
+
+    for (int instrument = 0; instrument < NUM_INSTRUMENTS; instrument++) {
+        WaveBench wave = {instrument, 0.0f};
+        snprintf(name, sizeof(name), "wave/%s", instrument_short_names[instrument]);
+        Bench bench = {name, run_wave, &wave, BENCH_FRAMES, BENCH_RATE};
+        run_bench(&bench);
+    }
+
+    for (int instrument = 0; instrument < NUM_INSTRUMENTS; instrument++) {
+        SynthBench synth = {instrument, osc_bank_select("auto"), points, num_windows, out};
+        snprintf(name, sizeof(name), "synth/%s", instrument_short_names[instrument]);
+        Bench bench = {name, run_synth, &synth, BENCH_FRAMES, BENCH_RATE};
+        run_bench(&bench);
+    }
+    for (int k = 0; k < NUM_OSC_BANK_KERNELS; k++) {
+        OscBankKernel kernel = osc_bank_select(osc_bank_kernel_names[k]);
+        if (!kernel) continue;
+        SynthBench synth = {INSTR_PAD, kernel, points, num_windows, out};
+        snprintf(name, sizeof(name), "synth/pad/%s", osc_bank_kernel_names[k]);
+        Bench bench = {name, run_synth, &synth, BENCH_FRAMES, BENCH_RATE};
+        run_bench(&bench);
+    }
+
+    EffectBench effect;
+    memset(&effect, 0, sizeof(effect));
+    effect.channels = 1;
+    effect.input = mono;
+    effect.buffer = buffer;
+    effect.out = out;
+    effect.delay = delay;
+    chorus_init(&effect.chorus, BENCH_RATE, CHORUS_MIX);
+    Bench chorus_bench = {"chorus", run_chorus, &effect, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&chorus_bench);
+    chorus_free(&effect.chorus);
+
+    effect.channels = 2;
+    effect.input = stereo;
+    effect.reverb = reverb_create(REVERB_MIX, REVERB_DECAY);
+    Bench reverb_bench = {"reverb/stereo", run_reverb, &effect, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&reverb_bench);
+    reverb_destroy(effect.reverb);
+
+    echo_init(&effect.echo, 2, BENCH_RATE, 0.8f, 0.9f, 1.0f, 0.3f);
+    Bench echo_bench = {"echo/stereo", run_echo, &effect, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&echo_bench);
+    echo_free(&effect.echo);
+
+    resampler_init(&effect.resampler, 48000, BENCH_RATE, 2);
+    Bench resample_bench = {"resample/48000-44100", run_resample, &effect, BENCH_FRAMES, 48000};
+    run_bench(&resample_bench);
+    resampler_free(&effect.resampler);
+
+    limiter_init(&effect.limiter, 2, BENCH_RATE, 0.891f, 0.005f, 0.08f);
+    for (int i = 0; i < BENCH_FRAMES * 2; i++) buffer[i] = stereo[i] * 4.0f;  // Over the ceiling
+    effect.input = buffer;
+    Bench limiter_bench = {"limiter/stereo", run_limiter, &effect, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&limiter_bench);
+    limiter_free(&effect.limiter);
+
+    float *bus = (float*)malloc(sizeof(float) * BENCH_FRAMES * 2);
+    MixBench mix = {1, mono, bus};
+    Bench mix_mono = {"mix/mono-to-stereo", run_mix, &mix, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&mix_mono);
+    mix.track_channels = 2;
+    mix.track = stereo;
+    Bench mix_stereo = {"mix/stereo", run_mix, &mix, BENCH_FRAMES, BENCH_RATE};
+    run_bench(&mix_stereo);
+    free(bus);
+
+    // End to end: generated sweeps (a mapped 16-bit mono file, and a stereo float
+    // one at 48 kHz) and the bundled samples
+    printf("\nRenders (analysis and synthesis of a whole file, pad, %d analysis thread%s)\n",
+           default_thread_count(), default_thread_count() == 1 ? "" : "s");
+    char dir[] = "/tmp/whistler-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Could not create a directory for the sweeps\n");
+        return 1;
+    }
+    char sweep_mono[64], sweep_stereo[64];
+    snprintf(sweep_mono, sizeof(sweep_mono), "%s/sweep_mono.wav", dir);
+    snprintf(sweep_stereo, sizeof(sweep_stereo), "%s/sweep_stereo.wav", dir);
+    if (write_sweep(sweep_mono, 1, 44100, SF_FORMAT_PCM_16) ||
+        write_sweep(sweep_stereo, 2, 48000, SF_FORMAT_FLOAT)) {
+        fprintf(stderr, "Error: Could not write the sweeps to %s\n", dir);
+        return 1;
+    }
+    bench_render("sweep-mono-44100-s16", sweep_mono);
+    bench_render("sweep-stereo-48000-f32", sweep_stereo);
+    unlink(sweep_mono);
+    unlink(sweep_stereo);
+    rmdir(dir);
+
+    glob_t found;
+    memset(&found, 0, sizeof(found));
+    if (num_files == 0) {
+        glob("samples/*.wav", 0, NULL, &found);
+        free(files);
+        files = found.gl_pathv;
+        num_files = (int)found.gl_pathc;
+    }
+    for (int f = 0; f < num_files; f++) {
+        const char *base = strrchr(files[f], '/');
+        bench_render(base ? base + 1 : files[f], files[f]);
+    }
+
+    if (json_file) {
+        if (write_results(json_file, best_kernel_name())) {
+            fprintf(stderr, "Error: Could not write %s\n", json_file);
+            return 1;
+        }
+        printf("\nWrote %d results to %s\n", num_results, json_file);
+    }
+
+    if (found.gl_pathc > 0) {
+        globfree(&found);
+    } else {
+        free(files);
+    }
+    free(mono);
+    free(stereo);
+    free(buffer);
+    free(out);
+    free(delay);
+    free(points);
+    return 0;
+}
@@ -0,0 +1,262 @@
+// pitch_bench.c - compare the pitch engines for accuracy (on synthetic tones with a
+// known pitch) and speed (on the bundled samples), and check that each gives the
+// same points however its windows are batched
+//
+// Usage: bench/pitch_bench [sample.wav ...]     (default: samples/*.wav)
+// Exits 1 if an engine's points depend on the batching.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include "../src/whistler.h"
+
+#define BENCH_SECONDS 2.0f      // Length of each synthetic tone
+#define BENCH_TONES 24          // Steady tones, log-spaced over the pitch range
+#define GROSS_CENTS 50.0f       // Further off than this counts as a gross error
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Run an engine over a mono signal; returns the number of windows (peaks is malloc'd)
+static int run_engine(const PitchEngine *engine, const float *signal, sf_count_t frames, int samplerate,
+                      FrequencyPoint **peaks, double *seconds) {
+    int num_windows = (int)((frames - WINDOW_SIZE) / HOP_SIZE + 1);
+    *peaks = (FrequencyPoint*)malloc(num_windows * sizeof(FrequencyPoint));
+    void *state = engine->create(samplerate, ANALYSIS_BATCH, FFTW_ESTIMATE);
+    if (!*peaks || !state) {
+        fprintf(stderr, "Error: Could not set up the %s engine\n", engine->name);
+        exit(1);
+    }
+    double start = now_seconds();
+    engine->analyze(state, signal, 1, HOP_SIZE, num_windows, 0,
+                    (int)(frames - ((sf_count_t)(num_windows - 1) * HOP_SIZE + WINDOW_SIZE)), *peaks);
+    *seconds = now_seconds() - start;
+    engine->destroy(state);
+    resolve_pitch_track(*peaks, num_windows);
+    return num_windows;
+}
+
+// A harmonic tone (gliding from f0 to f1) with a little noise, like a whistle or hum
+static float *make_tone(float f0, float f1, sf_count_t frames, int samplerate) {
+    float *signal = (float*)malloc(frames * sizeof(float));
+    double phase = 0.0;
+    srand(1234);
+    for (sf_count_t i = 0; i < frames; i++) {
+        float t = (float)i / frames;
+        float frequency = f0 + (f1 - f0) * t;
+        phase += 2.0 * M_PI * frequency / samplerate;
+        float noise = ((float)rand() / RAND_MAX - 0.5f) * 0.02f;
+        signal[i] = 0.3f * (float)sin(phase) + 0.12f * (float)sin(2 * phase) +
+                    0.06f * (float)sin(3 * phase) + noise;
+    }
+    return signal;
+}
+
+// Error in cents of every window of a tone against its true pitch at the window centre
+static void tone_errors(const PitchEngine *engine, float f0, float f1, int samplerate,
+                        float *errors, int *count, double *seconds, sf_count_t *analysed) {
+    sf_count_t frames = (sf_count_t)(BENCH_SECONDS * samplerate);
+    float *signal = make_tone(f0, f1, frames, samplerate);
+    FrequencyPoint *peaks;
+    double elapsed;
+    int num_windows = run_engine(engine, signal, frames, samplerate, &peaks, &elapsed);
+    *seconds += elapsed;
+    *analysed += frames;
+
+    for (int w = 0; w < num_windows; w++) {
+        float centre = (float)(w * HOP_SIZE + WINDOW_SIZE / 2) / frames;
+        float truth = f0 + (f1 - f0) * centre;
+        float detected = peaks[w].frequency;
+        errors[(*count)++] = detected > 0.0f ? fabsf(1200.0f * log2f(detected / truth)) : 1200.0f;
+    }
+    free(peaks);
+    free(signal);
+}
+
+// Run an engine over a mono signal `batch` windows at a time, each run told of the
+// real frames either side of it as the file and live analysis do. The state is
+// made for ANALYSIS_BATCH windows whatever the batch, so every run transforms with
+// the same plan and only the engine's handling of the batches can differ.
+static void run_batched(const PitchEngine *engine, void *state, const float *signal, sf_count_t frames,
+                        int batch, int num_windows, FrequencyPoint *peaks) {
+    for (int first = 0; first < num_windows; first += batch) {
+        int count = num_windows - first < batch ? num_windows - first : batch;
+        sf_count_t start = (sf_count_t)first * HOP_SIZE;
+        sf_count_t end = start + (sf_count_t)(count - 1) * HOP_SIZE + WINDOW_SIZE;
+        int before = start < ANALYSIS_GUARD ? (int)start : ANALYSIS_GUARD;
+        int after = frames - end < ANALYSIS_GUARD ? (int)(frames - end) : ANALYSIS_GUARD;
+        engine->analyze(state, signal + start, 1, HOP_SIZE, count, before, after, peaks + first);
+    }
+}
+
+// Largest difference between an engine's raw points at batches of 1, LIVE_ANALYSIS_BATCH
+// and ANALYSIS_BATCH windows, relative to the larger of each pair. They should be
+// identical; returns whether they are.
+static int check_batching(const PitchEngine *engine, int samplerate) {
+    int batches[] = {1, LIVE_ANALYSIS_BATCH, ANALYSIS_BATCH};
+    int num_batches = sizeof(batches) / sizeof(batches[0]);
+    sf_count_t frames = (sf_count_t)(BENCH_SECONDS * samplerate);
+    int num_windows = (int)((frames - WINDOW_SIZE) / HOP_SIZE + 1);
+    float *signal = make_tone(220.0f, 880.0f, frames, samplerate);
+    FrequencyPoint *reference = (FrequencyPoint*)malloc(num_windows * sizeof(FrequencyPoint));
+    FrequencyPoint *peaks = (FrequencyPoint*)malloc(num_windows * sizeof(FrequencyPoint));
+    void *state = engine->create(samplerate, ANALYSIS_BATCH, FFTW_ESTIMATE);
+    if (!reference || !peaks || !state) {
+        fprintf(stderr, "Error: Could not set up the %s engine\n", engine->name);
+        exit(1);
+    }
+    run_batched(engine, state, signal, frames, batches[num_batches - 1], num_windows, reference);
+
+    printf("  %-9s", engine->name);
+    int agree = 1;
+    for (int b = 0; b < num_batches - 1; b++) {
+        run_batched(engine, state, signal, frames, batches[b], num_windows, peaks);
+        float worst = 0.0f;
+        for (int w = 0; w < num_windows; w++) {
+            float values[2][2] = {{peaks[w].frequency, reference[w].frequency},
+                                  {peaks[w].amplitude, reference[w].amplitude}};
+            for (int v = 0; v < 2; v++) {
+                float larger = fmaxf(fabsf(values[v][0]), fabsf(values[v][1]));
+                float difference = larger > 0.0f ? fabsf(values[v][0] - values[v][1]) / larger : 0.0f;
+                if (difference > worst) worst = difference;
+            }
+        }
+        printf("  batch %2d vs %d: %.2g", batches[b], batches[num_batches - 1], worst);
+        if (worst > 0.0f) agree = 0;
+    }
+    printf("%s\n", agree ? "" : "  <-- depends on batching");
+    engine->destroy(state);
+    free(peaks);
+    free(reference);
+    free(signal);
+    return agree;
+}
+
+static void report_accuracy(const char *label, const PitchEngine *engine, float *errors, int count,
+                            double seconds, sf_count_t frames, int samplerate) {
+    int gross = 0;
+    double total = 0.0;
+    for (int i = 0; i < count; i++) {
+        if (errors[i] > GROSS_CENTS) gross++;
+        else total += errors[i];
+    }
+    qsort(errors, count, sizeof(float), compare_floats);
+    printf("  %-9s %-22s median %7.2f cents  mean (fine) %7.2f cents  gross %5.1f%%  %6.1fx realtime\n",
+           engine->name, label, errors[count / 2], count > gross ? total / (count - gross) : 0.0,
+           100.0 * gross / count, frames / (double)samplerate / seconds);
+}
+
+int main(int argc, char *argv[]) {
+    int samplerates[] = {44100, 48000};
+
+    printf("Accuracy on synthetic tones (%d steady tones %g-%g Hz, plus glides)\n",
+           BENCH_TONES, MIN_FREQUENCY, MAX_FREQUENCY);
+    for (int r = 0; r < 2; r++) {
+        int samplerate = samplerates[r];
+        printf(" %d Hz\n", samplerate);
+        for (int e = 0; e < num_pitch_engines; e++) {
+            const PitchEngine *engine = &pitch_engines[e];
+            int per_tone = (int)((BENCH_SECONDS * samplerate - WINDOW_SIZE) / HOP_SIZE + 1);
+            float *errors = (float*)malloc(sizeof(float) * per_tone * (BENCH_TONES + 2));
+            int count = 0;
+            double seconds = 0.0;
+            sf_count_t frames = 0;
+
+            // Steady tones, kept clear of the range ends so the truth is in range
+            for (int t = 0; t < BENCH_TONES; t++) {
+                float low = MIN_FREQUENCY * 1.05f;
+                float high = MAX_FREQUENCY * 0.95f;
+                float f = low * powf(high / low, (float)t / (BENCH_TONES - 1));
+                tone_errors(engine, f, f, samplerate, errors, &count, &seconds, &frames);
+            }
+            report_accuracy("steady", engine, errors, count, seconds, frames, samplerate);
+
+            count = 0;
+            seconds = 0.0;
+            frames = 0;
+            tone_errors(engine, 220.0f, 880.0f, samplerate, errors, &count, &seconds, &frames);
+            tone_errors(engine, 1200.0f, 300.0f, samplerate, errors, &count, &seconds, &frames);
+            report_accuracy("glide", engine, errors, count, seconds, frames, samplerate);
+            free(errors);
+        }
+    }
+
+    printf("\nBatch consistency (largest relative difference in raw points on a glide)\n");
+    int consistent = 1;
+    for (int r = 0; r < 2; r++) {
+        printf(" %d Hz\n", samplerates[r]);
+        for (int e = 0; e < num_pitch_engines; e++) {
+            consistent &= check_batching(&pitch_engines[e], samplerates[r]);
+        }
+    }
+
+    // Speed, and agreement with the default engine, on real takes
+    glob_t found;
+    memset(&found, 0, sizeof(found));
+    char **files = argv + 1;
+    int num_files = argc - 1;
+    if (num_files == 0) {
+        glob("samples/*.wav", 0, NULL, &found);
+        files = found.gl_pathv;
+        num_files = (int)found.gl_pathc;
+    }
+
+    printf("\nSpeed on samples (channel 0; agreement is against the %s engine)\n", pitch_engines[0].name);
+    for (int f = 0; f < num_files; f++) {
+        AudioBuffer input;
+        if (audio_buffer_read(files[f], &input) || input.frames < WINDOW_SIZE) {
+            fprintf(stderr, "Skipping %s\n", files[f]);
+            continue;
+        }
+        float *mono = (float*)malloc(input.frames * sizeof(float));
+        for (sf_count_t i = 0; i < input.frames; i++) {
+            mono[i] = input.samples[i * input.channels];
+        }
+
+        printf(" %s (%d Hz, %.1f s)\n", files[f], input.samplerate, (double)input.frames / input.samplerate);
+        FrequencyPoint *reference = NULL;
+        for (int e = 0; e < num_pitch_engines; e++) {
+            const PitchEngine *engine = &pitch_engines[e];
+            FrequencyPoint *peaks;
+            double seconds;
+            int num_windows = run_engine(engine, mono, input.frames, input.samplerate, &peaks, &seconds);
+
+            // Median difference over windows both engines call voiced
+            float *diffs = (float*)malloc(num_windows * sizeof(float));
+            int both = 0;
+            for (int w = 0; reference && w < num_windows; w++) {
+                if (reference[w].frequency > 0.0f && peaks[w].frequency > 0.0f) {
+                    diffs[both++] = fabsf(1200.0f * log2f(peaks[w].frequency / reference[w].frequency));
+                }
+            }
+            printf("  %-9s %8.0f windows/s  %7.1fx realtime  %7.1f ns/sample",
+                   engine->name, num_windows / seconds, input.frames / (double)input.samplerate / seconds,
+                   seconds * 1e9 / input.frames);
+            if (both > 0) {
+                qsort(diffs, both, sizeof(float), compare_floats);
+                printf("  median difference %.1f cents", diffs[both / 2]);
+            }
+            printf("\n");
+            free(diffs);
+
+            if (reference) free(peaks);
+            else reference = peaks;
+        }
+        free(reference);
+        free(mono);
+        audio_buffer_free(&input);
+    }
+    globfree(&found);
+    return consistent ? 0 : 1;
+}
@@ -0,0 +1,629 @@
+// analysis.c - pitch analysis of an input file, split across worker threads, and the
+// default FFT peak-picking pitch engine
+#include "whistler.h"
+#include <unistd.h> // For sysconf
+#ifdef __SSE2__
+    #include <immintrin.h>  // SSE2 magnitudes for the peak-pick
+#endif
+
+// FFTW's planner isn't thread-safe (only fftwf_execute is), so every plan
+// creation/destruction and wisdom import/export takes this lock
+pthread_mutex_t fftw_planner_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Planner rigour names, in the same order as planner_flags
+const char *planner_names[] = {"estimate", "measure", "patient"};
+const unsigned planner_flags[] = {FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT};
+
+void fft_context_destroy(FFTContext *ctx) {
+    if (!ctx) return;
+    if (ctx->plan) {
+        pthread_mutex_lock(&fftw_planner_lock);
+        fftwf_destroy_plan(ctx->plan);
+        pthread_mutex_unlock(&fftw_planner_lock);
+    }
+    fftwf_free(ctx->in);
+    fftwf_free(ctx->out);
+    fftwf_free(ctx->mags);
+    free(ctx->hann);
+    free(ctx);
+}
+
+FFTContext *fft_context_create(int n, int howmany, int samplerate, unsigned flags) {
+    FFTContext *ctx = (FFTContext*)calloc(1, sizeof(FFTContext));
+    if (!ctx) return NULL;
+    
+    ctx->n = n;
+    ctx->samplerate = samplerate;
+    ctx->howmany = howmany;
+    ctx->bins = n/2 + 1;
+    ctx->out_dist = (ctx->bins + 1) & ~1;  // Even bin count keeps every spectrum 16-byte aligned
+    ctx->decimation = 1;
+    ctx->in = (float*) fftwf_malloc(sizeof(float) * n * howmany);
+    ctx->out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * ctx->out_dist * howmany);
+    ctx->mags = (float*) fftwf_malloc(sizeof(float) * ctx->out_dist);
+    ctx->hann = (double*) malloc(sizeof(double) * n);
+    profile_alloc(PROFILE_ANALYSIS, sizeof(FFTContext) + sizeof(float) * n * howmany +
+                  sizeof(fftwf_complex) * ctx->out_dist * howmany + sizeof(float) * ctx->out_dist +
+                  sizeof(double) * n);
+    if (!ctx->in || !ctx->out || !ctx->mags || !ctx->hann) {
+        fft_context_destroy(ctx);
+        return NULL;
+    }
+    
+    // Kept in double precision (and written exactly as the original per-window
+    // expression) so windowed samples come out bit-identical
+    for (int i = 0; i < n; i++) {
+        ctx->hann[i] = 0.5 * (1 - cosf(2 * M_PI * i / (n - 1)));
+    }
+    
+    // FFTW_MEASURE/PATIENT scribble over the buffers while planning,
+    // which is fine since nothing has been copied in yet
+    pthread_mutex_lock(&fftw_planner_lock);
+    ctx->plan = fftwf_plan_many_dft_r2c(1, &n, howmany,
+                                        ctx->in, NULL, 1, n,
+                                        ctx->out, NULL, 1, ctx->out_dist,
+                                        flags);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    if (!ctx->plan) {
+        fft_context_destroy(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+// Find the loudest bin of one spectrum
+void peak_pick(FFTContext *ctx, const fftwf_complex *spectrum, float *frequency, float *amplitude) {
+    int bins = ctx->bins;
+    float *mags = ctx->mags;
+    int i = 0;
+    
+#ifdef __SSE2__
+    // Four bins at a time: square, de-interleave re/im, add and take the root.
+    // _mm_sqrt_ps is correctly rounded, so this matches sqrtf exactly.
+    const float *s = (const float*)spectrum;
+    for (; i + 4 <= bins; i += 4) {
+        __m128 a = _mm_load_ps(s + 2 * i);
+        __m128 b = _mm_load_ps(s + 2 * i + 4);
+        a = _mm_mul_ps(a, a);
+        b = _mm_mul_ps(b, b);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_store_ps(mags + i, _mm_sqrt_ps(_mm_add_ps(re, im)));
+    }
+#endif
+    for (; i < bins; i++) {
+        mags[i] = sqrtf(spectrum[i][0] * spectrum[i][0] + spectrum[i][1] * spectrum[i][1]);
+    }
+    
+    // Reduce to the maximum, then take the first bin holding it (same tie-breaking
+    // as a strict '>' scan starting from zero)
+    float max_amplitude = 0;
+    i = 0;
+#ifdef __SSE2__
+    __m128 vmax = _mm_setzero_ps();
+    for (; i + 4 <= bins; i += 4) {
+        vmax = _mm_max_ps(vmax, _mm_load_ps(mags + i));
+    }
+    vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    max_amplitude = _mm_cvtss_f32(vmax);
+#endif
+    for (; i < bins; i++) {
+        if (mags[i] > max_amplitude) max_amplitude = mags[i];
+    }
+    
+    int max_bin = 0;
+    if (max_amplitude > 0) {
+        while (mags[max_bin] != max_amplitude) max_bin++;
+    }
+    
+    *frequency = (float)max_bin * ctx->samplerate / (ctx->n * ctx->decimation);
+    *amplitude = max_amplitude;
+}
+
+// Analyse `count` consecutive hop windows of one channel, giving the raw loudest-bin
+// frequency and amplitude of each. `samples` points at the first frame of the first
+// window, `stride` is the distance between frames (the channel count) and `hop` the
+// distance between windows, in frames.
+void analyze_windows(FFTContext *ctx, const float *samples, int stride, int hop, int count, FrequencyPoint *peaks) {
+    int n = ctx->n;
+    
+    for (int first = 0; first < count; first += ctx->howmany) {
+        int batch = count - first < ctx->howmany ? count - first : ctx->howmany;
+        
+        // Lay out the batch of windowed frames, zeroing any unused tail of a short batch
+        for (int b = 0; b < batch; b++) {
+            const float *src = samples + (sf_count_t)(first + b) * hop * stride;
+            float *dst = ctx->in + (sf_count_t)b * n;
+            for (int i = 0; i < n; i++) {
+                dst[i] = src[(sf_count_t)i * stride];
+                dst[i] *= ctx->hann[i];
+            }
+        }
+        if (batch < ctx->howmany) {
+            memset(ctx->in + (sf_count_t)batch * n, 0, sizeof(float) * n * (ctx->howmany - batch));
+        }
+        
+        fftwf_execute(ctx->plan);
+        
+        for (int b = 0; b < batch; b++) {
+            peak_pick(ctx, ctx->out + (sf_count_t)b * ctx->out_dist,
+                      &peaks[first + b].frequency, &peaks[first + b].amplitude);
+        }
+    }
+}
+
+void *peak_engine_create(int samplerate, int batch, unsigned planner_flags) {
+    return fft_context_create(WINDOW_SIZE, batch, samplerate, planner_flags);
+}
+
+void peak_engine_destroy(void *state) {
+    fft_context_destroy((FFTContext*)state);
+}
+
+void peak_engine_analyze(void *state, const float *samples, int stride, int hop, int count, int before, int after,
+                         FrequencyPoint *peaks) {
+    (void)before;
+    (void)after;
+    analyze_windows((FFTContext*)state, samples, stride, hop, count, peaks);
+}
+
+// The peak picker transforms the whole window
+int peak_engine_lookahead(int samplerate) {
+    (void)samplerate;
+    return WINDOW_SIZE;
+}
+
+// Pitch engines for --pitch-engine; the first is the default. An engine's id is
+// recorded in pitch track sidecars, so ids must never be reused.
+const PitchEngine pitch_engines[] = {
+    {"peak",      0, peak_engine_create,      peak_engine_destroy,      peak_engine_analyze,
+     peak_engine_lookahead},
+    {"yin",       1, yin_engine_create,       yin_engine_destroy,       yin_engine_analyze,
+     yin_engine_lookahead},
+    {"decimated", 2, decimated_engine_create, decimated_engine_destroy, decimated_engine_analyze,
+     decimated_engine_lookahead},
+};
+const int num_pitch_engines = sizeof(pitch_engines) / sizeof(pitch_engines[0]);
+
+// Look an engine up by name (NULL for the default)
+const PitchEngine *pitch_engine_find(const char *name) {
+    if (!name) return &pitch_engines[0];
+    for (int e = 0; e < num_pitch_engines; e++) {
+        if (STR_COMPARE(name, pitch_engines[e].name) == 0) return &pitch_engines[e];
+    }
+    return NULL;
+}
+
+// Whether a raw peak will set the pitch (see resolve_pitch_point)
+static inline int peak_voiced(const FrequencyPoint *peak) {
+    return peak->amplitude > AMP_THRESHOLD && peak->frequency >= MIN_FREQUENCY && peak->frequency <= MAX_FREQUENCY;
+}
+
+// Whether the windows between two coarse neighbours can be interpolated rather than
+// analysed: both hold the same pitch, or both hold none, at much the same level
+static int adaptive_stable(const FrequencyPoint *a, const FrequencyPoint *b) {
+    int voiced = peak_voiced(a);
+    if (voiced != peak_voiced(b)) return 0;
+    if (voiced && 1200.0f * fabsf(log2f(b->frequency / a->frequency)) > ADAPTIVE_MAX_CENTS) return 0;
+    if (a->amplitude <= AMP_THRESHOLD && b->amplitude <= AMP_THRESHOLD) return 1;
+    float louder = a->amplitude > b->amplitude ? a->amplitude : b->amplitude;
+    return fabsf(a->amplitude - b->amplitude) <= ADAPTIVE_MAX_AMP_CHANGE * louder;
+}
+
+// Frames an engine may read beyond a run of windows, of the `frames` of input there
+static inline int analysis_guard(sf_count_t frames) {
+    return frames < ANALYSIS_GUARD ? (int)frames : ANALYSIS_GUARD;
+}
+
+// Analyse up to ADAPTIVE_REGION consecutive hop windows with an adaptive hop. Every
+// ADAPTIVE_HOPS-th window (and the last) goes through the engine in one batch; then
+// the windows between each pair of those are analysed only if the pair differ, and
+// are interpolated from it where it's stable (with no pitch at all between unvoiced
+// neighbours, so the last valid one carries on). Returns the number of windows analysed.
+static int analyze_adaptive(const PitchEngine *engine, void *state, void *fine, const float *samples,
+                            int stride, int count, int before, int after, FrequencyPoint *peaks) {
+    FrequencyPoint coarse[ANALYSIS_BATCH];
+    int num_coarse = (count - 1) / ADAPTIVE_HOPS + 1;
+    int coarse_after = analysis_guard(after + (sf_count_t)(count - 1 - (num_coarse - 1) * ADAPTIVE_HOPS) * HOP_SIZE);
+    engine->analyze(state, samples, stride, ADAPTIVE_HOPS * HOP_SIZE, num_coarse, before, coarse_after, coarse);
+    for (int c = 0; c < num_coarse; c++) {
+        peaks[c * ADAPTIVE_HOPS] = coarse[c];
+    }
+    int analysed = num_coarse;
+    int last = count - 1;
+    if (last % ADAPTIVE_HOPS != 0) {
+        engine->analyze(fine, samples + (sf_count_t)last * HOP_SIZE * stride, stride, HOP_SIZE, 1,
+                        analysis_guard(before + (sf_count_t)last * HOP_SIZE), after, &peaks[last]);
+        analysed++;
+    }
+    
+    for (int a = 0; a < last; a += ADAPTIVE_HOPS) {
+        int b = a + ADAPTIVE_HOPS < last ? a + ADAPTIVE_HOPS : last;
+        if (b - a < 2) continue;
+        if (adaptive_stable(&peaks[a], &peaks[b])) {
+            int voiced = peak_voiced(&peaks[a]);
+            for (int w = a + 1; w < b; w++) {
+                float t = (float)(w - a) / (b - a);
+                peaks[w].frequency = voiced ? peaks[a].frequency + t * (peaks[b].frequency - peaks[a].frequency) : 0.0f;
+                peaks[w].amplitude = peaks[a].amplitude + t * (peaks[b].amplitude - peaks[a].amplitude);
+            }
+        } else {
+            engine->analyze(fine, samples + (sf_count_t)(a + 1) * HOP_SIZE * stride, stride, HOP_SIZE, b - a - 1,
+                            analysis_guard(before + (sf_count_t)(a + 1) * HOP_SIZE),
+                            analysis_guard(after + (sf_count_t)(last - b + 1) * HOP_SIZE), peaks + a + 1);
+            analysed += b - a - 1;
+        }
+    }
+    return analysed;
+}
+
+// A contiguous run of hop windows analysed by one worker thread with its own engine state
+typedef struct {
+    const PitchEngine *engine;
+    void *state;
+    void *fine;             // Fine-hop state for adaptive hops (NULL: analyse every window)
+    const float *samples;   // First frame of the first window (NULL: convert from map)
+    int stride;
+    const WavMap *map;      // Mapped input (NULL if samples is a chunk in memory)
+    sf_count_t first_frame; // Frame of the map the first window starts at
+    int channel;            // Channel of the map to convert
+    float *block;           // One unit's frames to convert the channel into
+    int count;
+    int before;             // Real frames before the first window and past the last (see PitchEngine)
+    int after;
+    FrequencyPoint *peaks;
+    int analysed;           // Windows the engine looked at
+    int profile_track;      // Track the work is profiled against
+} AnalysisJob;
+
+// Windows handed out and scheduled together: a batch, or an adaptive region. With
+// adaptive hops the result depends on where regions start, so they always start
+// on this grid, whatever the thread count.
+static int analysis_unit(void **fine_states) {
+    return fine_states ? ADAPTIVE_REGION : ANALYSIS_BATCH;
+}
+
+// Analyse a run of windows with the job's engine: every window, or region by region
+// with adaptive hops
+static void analyze_run(AnalysisJob *job, const float *samples, int stride, int count, int before, int after,
+                        FrequencyPoint *peaks) {
+    if (!job->fine) {
+        job->engine->analyze(job->state, samples, stride, HOP_SIZE, count, before, after, peaks);
+        job->analysed += count;
+        return;
+    }
+    for (int first = 0; first < count; first += ADAPTIVE_REGION) {
+        int region = count - first < ADAPTIVE_REGION ? count - first : ADAPTIVE_REGION;
+        job->analysed += analyze_adaptive(job->engine, job->state, job->fine,
+                                          samples + (sf_count_t)first * HOP_SIZE * stride, stride, region,
+                                          analysis_guard(before + (sf_count_t)first * HOP_SIZE),
+                                          analysis_guard(after + (sf_count_t)(count - first - region) * HOP_SIZE),
+                                          peaks + first);
+    }
+}
+
+void *analysis_worker(void *arg) {
+    AnalysisJob *job = (AnalysisJob*)arg;
+    profile_set_track(job->profile_track);
+    if (!job->map) {
+        int64_t start = profile_begin();
+        analyze_run(job, job->samples, job->stride, job->count, job->before, job->after, job->peaks);
+        profile_end(PROFILE_ANALYSIS, start);
+        return NULL;
+    }
+    
+    // Mapped input goes a unit at a time: converted (if need be) into a block small
+    // enough to stay in cache, and with the pages behind let go every few batches so
+    // resident memory doesn't grow with the file. A block also holds the guard
+    // frames either side of its windows.
+    int unit = job->fine ? ADAPTIVE_REGION : ANALYSIS_BATCH;
+    sf_count_t released = job->first_frame;
+    for (int first = 0; first < job->count; first += unit) {
+        int batch = job->count - first < unit ? job->count - first : unit;
+        sf_count_t frame = job->first_frame + (sf_count_t)first * HOP_SIZE;
+        int before = analysis_guard(job->before + (sf_count_t)first * HOP_SIZE);
+        int after = analysis_guard(job->after + (sf_count_t)(job->count - first - batch) * HOP_SIZE);
+        if (job->samples) {
+            int64_t start = profile_begin();
+            analyze_run(job, job->samples + (sf_count_t)first * HOP_SIZE * job->stride, job->stride, batch,
+                        before, after, job->peaks + first);
+            profile_end(PROFILE_ANALYSIS, start);
+        } else {
+            int64_t start = profile_begin();
+            wav_map_read_channel(job->map, job->channel, frame - before,
+                                 before + (batch - 1) * HOP_SIZE + WINDOW_SIZE + after, job->block);
+            profile_end(PROFILE_DECODE, start);
+            start = profile_begin();
+            analyze_run(job, job->block + before, 1, batch, before, after, job->peaks + first);
+            profile_end(PROFILE_ANALYSIS, start);
+        }
+        
+        sf_count_t done = frame + (sf_count_t)batch * HOP_SIZE;  // The next window starts here
+        if (done - released >= (sf_count_t)ANALYSIS_CHUNK_BATCHES * ANALYSIS_BATCH * HOP_SIZE ||
+            first + batch == job->count) {
+            wav_map_release(job->map, released, done - released);
+            released = done;
+        }
+    }
+    return NULL;
+}
+
+// Split the windows across one thread per engine state. Windows are independent,
+// so each worker writes its own slice of `peaks` and nothing is shared. The
+// windows start at `samples` (with `map`, at the start of the mapped input, whose
+// `channel` is converted into each worker's block if `samples` is NULL), with
+// `before` and `after` real frames either side of them. Returns the number of
+// windows the engine analysed.
+int analyze_windows_parallel(const PitchEngine *engine, void **states, void **fine_states, int num_threads,
+                             const float *samples, int stride, const WavMap *map, int channel, float **blocks,
+                             int count, int before, int after, FrequencyPoint *peaks) {
+    int unit = analysis_unit(fine_states);
+    if (num_threads <= 1 || count <= unit) {
+        AnalysisJob job = {engine, states[0], fine_states ? fine_states[0] : NULL, samples, stride, map, 0,
+                           channel, blocks ? blocks[0] : NULL, count, before, after, peaks, 0, profile_get_track()};
+        analysis_worker(&job);
+        return job.analysed;
+    }
+    
+    pthread_t threads[num_threads];
+    AnalysisJob jobs[num_threads];
+    int started[num_threads];
+    
+    // Whole units per worker so no batch (or region) is split needlessly
+    int units = (count + unit - 1) / unit;
+    int first = 0;
+    for (int t = 0; t < num_threads; t++) {
+        int share = units / num_threads + (t < units % num_threads ? 1 : 0);
+        int windows = share * unit;
+        if (first + windows > count) windows = count - first;
+        
+        jobs[t].engine = engine;
+        jobs[t].state = states[t];
+        jobs[t].fine = fine_states ? fine_states[t] : NULL;
+        jobs[t].samples = samples ? samples + (sf_count_t)first * HOP_SIZE * stride : NULL;
+        jobs[t].stride = stride;
+        jobs[t].map = map;
+        jobs[t].first_frame = (sf_count_t)first * HOP_SIZE;
+        jobs[t].channel = channel;
+        jobs[t].block = blocks ? blocks[t] : NULL;
+        jobs[t].count = windows;
+        jobs[t].before = analysis_guard(before + (sf_count_t)first * HOP_SIZE);
+        jobs[t].after = analysis_guard(after + (sf_count_t)(count - first - windows) * HOP_SIZE);
+        jobs[t].peaks = peaks + first;
+        jobs[t].analysed = 0;
+        jobs[t].profile_track = profile_get_track();
+        first += windows;
+        
+        started[t] = windows > 0 && pthread_create(&threads[t], NULL, analysis_worker, &jobs[t]) == 0;
+        if (windows > 0 && !started[t]) {
+            analysis_worker(&jobs[t]);  // Couldn't spawn - do it on this thread instead
+        }
+    }
+    
+    int analysed = 0;
+    for (int t = 0; t < num_threads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+        analysed += jobs[t].analysed;
+    }
+    return analysed;
+}
+
+// Number of online cores, used as the default analysis thread count
+int default_thread_count(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+// Read the input in chunks and analyse every hop window of the first `voices`
+// channels into raw peaks (num_windows per channel, one channel after another).
+// Only a chunk of frames (sized by the thread count, not the file) is held at a time;
+// consecutive chunks overlap by WINDOW_SIZE - HOP_SIZE frames, plus the guard frames
+// either side that an engine may read.
+int analyze_file(SNDFILE *infile, const SF_INFO *sfinfo, const PitchEngine *engine, void **states,
+                 void **fine_states, int num_threads, int num_windows, int voices, FrequencyPoint *peaks,
+                 int *analysed) {
+    int channels = sfinfo->channels;
+    int unit = analysis_unit(fine_states);
+    int chunk_windows = ANALYSIS_BATCH * ANALYSIS_CHUNK_BATCHES * num_threads;  // A multiple of every unit
+    sf_count_t capacity = ANALYSIS_GUARD + (sf_count_t)(chunk_windows - 1) * HOP_SIZE + WINDOW_SIZE + ANALYSIS_GUARD;
+    float *chunk = malloc(capacity * channels * sizeof(float));
+    profile_alloc(PROFILE_DECODE, capacity * channels * sizeof(float));
+    if (!chunk) {
+        printf("Failed to allocate memory\n");
+        return 1;
+    }
+    
+    *analysed = 0;
+    sf_count_t filled = 0;  // Frames currently held in chunk
+    int before = 0;         // Of them, guard frames ahead of window w
+    int ended = 0;
+    int w = 0;              // First window not yet analysed (starts at chunk[before])
+    while (w < num_windows) {
+        int64_t start = profile_begin();
+        sf_count_t got = sf_readf_float(infile, chunk + filled * channels, capacity - filled);
+        profile_end(PROFILE_DECODE, start);
+        filled += got;
+        if (got == 0) ended = 1;
+        
+        // Windows with their guard frames after them read too (or every one, once the
+        // input has ended). Whole units only until the end, so units stay on their grid
+        // however the reads fall.
+        sf_count_t usable = filled - before - (ended ? 0 : ANALYSIS_GUARD);
+        int available = usable >= WINDOW_SIZE ? (int)((usable - WINDOW_SIZE) / HOP_SIZE) + 1 : 0;
+        if (available > num_windows - w) available = num_windows - w;
+        if (available < num_windows - w) available -= available % unit;
+        if (available == 0) {
+            if (!ended) continue;
+            printf("Error: Input ended early\n");
+            free(chunk);
+            return 1;
+        }
+        
+        // Each channel of the chunk in turn, across every thread
+        int after = analysis_guard(filled - before - ((sf_count_t)(available - 1) * HOP_SIZE + WINDOW_SIZE));
+        for (int v = 0; v < voices; v++) {
+            *analysed += analyze_windows_parallel(engine, states, fine_states, num_threads,
+                                                  chunk + (sf_count_t)before * channels + v, channels, NULL, 0,
+                                                  NULL, available, before, after,
+                                                  peaks + (sf_count_t)v * num_windows + w);
+        }
+        w += available;
+        
+        // Keep the overlap that the next window still needs, and the guard frames ahead of it
+        sf_count_t next = before + (sf_count_t)available * HOP_SIZE;
+        int keep = analysis_guard(next);
+        memmove(chunk, chunk + (next - keep) * channels, (filled - next + keep) * channels * sizeof(float));
+        filled -= next - keep;
+        before = keep;
+    }
+    
+    free(chunk);
+    return 0;
+}
+
+// Analyse every hop window of the first `voices` channels of a mapped input into
+// raw peaks, laid out as by analyze_file. Nothing is read up front: each worker
+// converts its own region a unit at a time, or reads 32-bit float input where it
+// lies. Channels go one after another, each across every thread.
+int analyze_mapped(const WavMap *map, const PitchEngine *engine, void **states, void **fine_states,
+                   int num_threads, int num_windows, int voices, FrequencyPoint *peaks, int *analysed) {
+    const float *samples = wav_map_floats(map);
+    int after = analysis_guard(map->frames - ((sf_count_t)(num_windows - 1) * HOP_SIZE + WINDOW_SIZE));
+    *analysed = 0;
+    if (samples) {
+        for (int v = 0; v < voices; v++) {
+            *analysed += analyze_windows_parallel(engine, states, fine_states, num_threads, samples + v,
+                                                  map->channels, map, v, NULL, num_windows, 0, after,
+                                                  peaks + (sf_count_t)v * num_windows);
+        }
+        return 0;
+    }
+    
+    int block_frames = (fine_states ? ADAPTIVE_REGION_FRAMES : ANALYSIS_BLOCK_FRAMES) + 2 * ANALYSIS_GUARD;
+    float *blocks[num_threads];
+    int failed = 0;
+    for (int t = 0; t < num_threads; t++) {
+        blocks[t] = (float*)malloc(block_frames * sizeof(float));
+        profile_alloc(PROFILE_DECODE, block_frames * sizeof(float));
+        failed |= !blocks[t];
+    }
+    if (failed) {
+        printf("Failed to allocate memory\n");
+    } else {
+        for (int v = 0; v < voices; v++) {
+            *analysed += analyze_windows_parallel(engine, states, fine_states, num_threads, NULL, 0, map, v,
+                                                  blocks, num_windows, 0, after, peaks + (sf_count_t)v * num_windows);
+        }
+    }
+    for (int t = 0; t < num_threads; t++) {
+        free(blocks[t]);
+    }
+    return failed;
+}
+
+// Resolve one raw peak into a pitch track point: keep the frequency only if the
+// window is loud enough and in range, else carry the last valid one forward
+static inline void resolve_pitch_point(FrequencyPoint *point, float *last_valid_frequency) {
+    float frequency = point->frequency;
+    float amplitude = point->amplitude;
+    
+    // Only update frequency if amplitude is above threshold and frequency is in range
+    if (amplitude > AMP_THRESHOLD && 
+        frequency >= MIN_FREQUENCY && frequency <= MAX_FREQUENCY) {
+        *last_valid_frequency = frequency;
+        point->frequency = frequency;
+    } else {
+        point->frequency = *last_valid_frequency;
+    }
+    point->amplitude = amplitude / AMP_SCALE;
+}
+
+// Turn raw peaks into the pitch track: resolve the carry-forward of the last valid
+// frequency in one cheap sequential pass and scale amplitudes
+void resolve_pitch_track(FrequencyPoint *freq_data, int num_windows) {
+    float last_valid_frequency = 0.0f;
+    for (int w = 0; w < num_windows; w++) {
+        resolve_pitch_point(&freq_data[w], &last_valid_frequency);
+    }
+}
+
+// Set up incremental analysis of one channel. `batch` windows are transformed at a
+// time at most, so small batches keep the work per hop (and so the latency) low.
+int pitch_tracker_init(PitchTracker *tracker, const PitchEngine *engine, int samplerate, int batch,
+                       unsigned planner_flags) {
+    memset(tracker, 0, sizeof(PitchTracker));
+    tracker->engine = engine;
+    tracker->lookahead = engine->lookahead(samplerate);
+    tracker->capacity = ANALYSIS_GUARD + (tracker->lookahead > WINDOW_SIZE ? tracker->lookahead : WINDOW_SIZE) +
+                        batch * HOP_SIZE;
+    tracker->samples = (float*)malloc(tracker->capacity * sizeof(float));
+    profile_alloc(PROFILE_ANALYSIS, tracker->capacity * sizeof(float));
+    tracker->state = engine->create(samplerate, batch, planner_flags);
+    if (!tracker->samples || !tracker->state) {
+        pitch_tracker_free(tracker);
+        return 1;
+    }
+    return 0;
+}
+
+void pitch_tracker_free(PitchTracker *tracker) {
+    if (tracker->state) tracker->engine->destroy(tracker->state);
+    free(tracker->samples);
+    tracker->state = NULL;
+    tracker->samples = NULL;
+}
+
+// Take up to `count` frames (every `stride`th sample) as the input arrives. Returns
+// how many were taken; the rest don't fit until the ready points have been pulled.
+int pitch_tracker_push(PitchTracker *tracker, const float *samples, int stride, int count) {
+    int space = tracker->capacity - tracker->filled;
+    if (count > space) count = space;
+    float *dst = tracker->samples + tracker->filled;
+    for (int i = 0; i < count; i++) {
+        dst[i] = samples[(sf_count_t)i * stride];
+    }
+    tracker->filled += count;
+    return count;
+}
+
+// Analyse and resolve the windows with at least `needed` frames pushed from their
+// start (up to max_points), then let go of the frames only they needed
+static int pitch_tracker_analyze(PitchTracker *tracker, int needed, FrequencyPoint *points, int max_points) {
+    int held = tracker->filled - tracker->before;
+    int ready = held >= needed ? (held - needed) / HOP_SIZE + 1 : 0;
+    if (ready > max_points) ready = max_points;
+    if (ready == 0) return 0;
+    
+    int64_t start = profile_begin();
+    int after = held - ((ready - 1) * HOP_SIZE + WINDOW_SIZE);
+    tracker->engine->analyze(tracker->state, tracker->samples + tracker->before, 1, HOP_SIZE, ready,
+                             tracker->before, after > 0 ? analysis_guard(after) : 0, points);
+    for (int w = 0; w < ready; w++) {
+        resolve_pitch_point(&points[w], &tracker->last_valid_frequency);
+    }
+    profile_end(PROFILE_ANALYSIS, start);
+    tracker->windows += ready;
+    
+    // Keep the overlap that the next window still needs, and the guard frames ahead of it
+    int next = tracker->before + ready * HOP_SIZE;
+    int keep = analysis_guard(next);
+    memmove(tracker->samples, tracker->samples + next - keep, (tracker->filled - next + keep) * sizeof(float));
+    tracker->filled -= next - keep;
+    tracker->before = keep;
+    return ready;
+}
+
+// Analyse and resolve every window the pushed input completes (up to max_points),
+// returning how many points were written. Point w is ready as soon as frame
+// w * HOP_SIZE + lookahead - 1 has been pushed: the engine never reads the rest of
+// its window (or anything past it).
+int pitch_tracker_pull(PitchTracker *tracker, FrequencyPoint *points, int max_points) {
+    return pitch_tracker_analyze(tracker, tracker->lookahead, points, max_points);
+}
+
+// The input has ended: analyse the whole windows still waiting on frames past
+// their end (silence now), as a file's last windows are
+int pitch_tracker_finish(PitchTracker *tracker, FrequencyPoint *points, int max_points) {
+    return pitch_tracker_analyze(tracker, WINDOW_SIZE, points, max_points);
+}
@@ -0,0 +1,314 @@
+// cache.c - content hashing, the on-disk render cache and pitch track sidecars
+#include "whistler.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hash a file's contents. FNV-1a's step goes a 64-bit word at a time rather than a
+// byte, with the high half folded back down so every bit of a word reaches every
+// bit of the hash; a chunk's last few bytes go a byte at a time.
+int hash_file(const char *path, uint64_t *hash) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return 1;
+    
+    unsigned char chunk[65536];
+    uint64_t h = FNV_OFFSET;
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        size_t words = got / sizeof(uint64_t);
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, chunk + i * sizeof(uint64_t), sizeof(uint64_t));
+            h = (h ^ word) * FNV_PRIME;
+            h ^= h >> 32;
+        }
+        h = fnv1a(h, chunk + words * sizeof(uint64_t), got - words * sizeof(uint64_t));
+    }
+    int failed = ferror(file);
+    fclose(file);
+    *hash = h;
+    return failed;
+}
+
+// A cheap stand-in for a file's hash: its size, modification time and inode, and
+// its first and last SOURCE_KEY_BLOCK bytes (a WAV's header and the end of its
+// data). Rewriting a file changes its modification time, so the key only misses
+// a change made behind the file system's back.
+int source_key(const char *path, uint64_t *key) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 1;
+    }
+#ifdef __APPLE__
+    long long mtime_ns = st.st_mtimespec.tv_nsec;
+#else
+    long long mtime_ns = st.st_mtim.tv_nsec;
+#endif
+    long long stamp[4] = {(long long)st.st_size, (long long)st.st_mtime, mtime_ns, (long long)st.st_ino};
+    uint64_t h = fnv1a(FNV_OFFSET, stamp, sizeof(stamp));
+    
+    unsigned char block[SOURCE_KEY_BLOCK];
+    off_t tail = st.st_size > SOURCE_KEY_BLOCK ? st.st_size - SOURCE_KEY_BLOCK : 0;
+    ssize_t head = pread(fd, block, sizeof(block), 0);
+    if (head >= 0) h = fnv1a(h, block, (size_t)head);
+    ssize_t last = head >= 0 ? pread(fd, block, sizeof(block), tail) : -1;
+    if (last >= 0) h = fnv1a(h, block, (size_t)last);
+    close(fd);
+    *key = h;
+    return last < 0;
+}
+
+// Use `dir` as the cache, creating it if needed
+int render_cache_open(RenderCache *cache, const char *dir, long long max_bytes) {
+    strncpy(cache->dir, dir, sizeof(cache->dir) - 1);
+    cache->dir[sizeof(cache->dir) - 1] = '\0';
+    cache->max_bytes = max_bytes;
+    
+    struct stat st;
+    if (stat(dir, &st) == 0) {
+        return S_ISDIR(st.st_mode) ? 0 : 1;
+    }
+    return mkdir(dir, 0755) == 0 ? 0 : 1;
+}
+
+static void render_cache_path(const RenderCache *cache, uint64_t key, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.wav", cache->dir, (unsigned long long)key);
+}
+
+// Open the entry for `key` to read back a block at a time, if there is one, and
+// mark it used. Returns NULL on a miss.
+SNDFILE *render_cache_read(const RenderCache *cache, uint64_t key, SF_INFO *info) {
+    char path[512];
+    render_cache_path(cache, key, path, sizeof(path));
+    memset(info, 0, sizeof(SF_INFO));
+    SNDFILE *file = access(path, R_OK) == 0 ? sf_open(path, SFM_READ, info) : NULL;
+    if (file) {
+        utime(path, NULL);  // Most recently used now
+    }
+    return file;
+}
+
+// Start writing the entry for `key`. It goes under a temporary name and is only
+// renamed into place by render_cache_commit(), so a reader never sees half an entry.
+int render_cache_begin(const RenderCache *cache, uint64_t key, int channels, int samplerate,
+                       RenderCacheWriter *writer) {
+    render_cache_path(cache, key, writer->path, sizeof(writer->path));
+    snprintf(writer->temp, sizeof(writer->temp), "%s.%ld.%p.tmp", writer->path, (long)getpid(),
+             (const void*)writer);
+    
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    sfinfo.samplerate = samplerate;
+    sfinfo.channels = channels;
+    sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    writer->file = sf_open(writer->temp, SFM_WRITE, &sfinfo);
+    return writer->file ? 0 : 1;
+}
+
+int render_cache_write(RenderCacheWriter *writer, const float *samples, int frames) {
+    return sf_writef_float(writer->file, samples, frames) == frames ? 0 : 1;
+}
+
+int render_cache_commit(RenderCacheWriter *writer) {
+    int failed = sf_close(writer->file) != 0;
+    writer->file = NULL;
+    if (failed || rename(writer->temp, writer->path) != 0) {
+        remove(writer->temp);
+        return 1;
+    }
+    return 0;
+}
+
+void render_cache_abort(RenderCacheWriter *writer) {
+    if (writer->file) sf_close(writer->file);
+    writer->file = NULL;
+    remove(writer->temp);
+}
+
+typedef struct {
+    char name[64];
+    time_t used;
+    long long bytes;
+} CacheEntry;
+
+static int compare_entries(const void *a, const void *b) {
+    time_t x = ((const CacheEntry*)a)->used;
+    time_t y = ((const CacheEntry*)b)->used;
+    return (x > y) - (x < y);
+}
+
+// Delete least recently used entries until the cache fits in max_bytes
+void render_cache_evict(const RenderCache *cache) {
+    DIR *dir = opendir(cache->dir);
+    if (!dir) return;
+    
+    CacheEntry *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    long long total = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len != 20 || strcmp(ent->d_name + 16, ".wav") != 0) continue;  // Only <16 hex>.wav
+        
+        char path[512];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, ent->d_name);
+        if (stat(path, &st) != 0) continue;
+        
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CacheEntry *grown = (CacheEntry*)realloc(entries, capacity * sizeof(CacheEntry));
+            if (!grown) break;
+            entries = grown;
+        }
+        strcpy(entries[count].name, ent->d_name);
+        entries[count].used = st.st_mtime;
+        entries[count].bytes = (long long)st.st_size;
+        total += entries[count].bytes;
+        count++;
+    }
+    closedir(dir);
+    
+    qsort(entries, count, sizeof(CacheEntry), compare_entries);
+    for (int i = 0; i < count && total > cache->max_bytes; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", cache->dir, entries[i].name);
+        if (remove(path) == 0) {
+            printf("Evicted %s from the render cache\n", entries[i].name);
+            total -= entries[i].bytes;
+        }
+    }
+    free(entries);
+}
+
+void pitch_track_sidecar_path(const char *input_file, char *path, size_t size) {
+    snprintf(path, size, "%s%s", input_file, PITCH_TRACK_EXTENSION);
+}
+
+// Fill in the header for the current analysis settings
+static void pitch_track_header(PitchTrackHeader *header, uint64_t source_key, uint64_t source_hash, int engine,
+                               uint32_t flags) {
+    memset(header, 0, sizeof(PitchTrackHeader));
+    memcpy(header->magic, PITCH_TRACK_MAGIC, 4);
+    header->version = PITCH_TRACK_VERSION;
+    header->byte_order = 0x01020304;
+    header->window_size = WINDOW_SIZE;
+    header->hop_size = HOP_SIZE;
+    header->engine = (uint32_t)engine;
+    header->flags = flags;
+    header->min_frequency = MIN_FREQUENCY;
+    header->max_frequency = MAX_FREQUENCY;
+    header->amp_threshold = AMP_THRESHOLD;
+    header->amp_scale = AMP_SCALE;
+    header->source_hash = source_hash;
+    header->source_key = source_key;
+}
+
+// Map a sidecar and use its points in place. Fails (returns 1) if it's missing,
+// truncated, or was made from different input, analysis settings or pitch engine.
+// The input's source_key is only worked out once the sidecar is there and its
+// settings match, and the input is only hashed if that key has changed; if the
+// hash still matches, the sidecar takes the new key so the next run needn't hash
+// it again.
+int pitch_track_load(const char *path, const char *input_file, int engine, uint32_t flags, PitchTrack *track) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PitchTrackHeader)) {
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return 1;
+    
+    // Everything but the input's format and identity has to match what we'd write now
+    const PitchTrackHeader *header = (const PitchTrackHeader*)mapping;
+    PitchTrackHeader expected;
+    pitch_track_header(&expected, header->source_key, header->source_hash, engine, flags);
+    expected.num_windows = header->num_windows;
+    expected.frames = header->frames;
+    expected.samplerate = header->samplerate;
+    expected.channels = header->channels;
+    int voices = (flags & PITCH_TRACK_PER_CHANNEL) ? (int)header->channels : 1;
+    if (memcmp(header, &expected, sizeof(PitchTrackHeader)) != 0 || header->num_windows == 0 || voices < 1 ||
+        size != sizeof(PitchTrackHeader) + (size_t)header->num_windows * voices * sizeof(FrequencyPoint)) {
+        munmap(mapping, size);
+        return 1;
+    }
+    uint64_t key;
+    if (source_key(input_file, &key)) {
+        munmap(mapping, size);
+        return 1;
+    }
+    if (header->source_key != key) {
+        uint64_t source_hash;
+        if (hash_file(input_file, &source_hash) || source_hash != header->source_hash) {
+            munmap(mapping, size);
+            return 1;
+        }
+        int fd = open(path, O_WRONLY);
+        if (fd >= 0) {
+            ssize_t written = pwrite(fd, &key, sizeof(key), offsetof(PitchTrackHeader, source_key));
+            (void)written;  // Failing that, the next run just hashes the input again
+            close(fd);
+        }
+    }
+    
+    memset(track, 0, sizeof(PitchTrack));
+    track->points = (FrequencyPoint*)((char*)mapping + sizeof(PitchTrackHeader));
+    track->num_windows = (int)header->num_windows;
+    track->voices = voices;
+    track->frames = header->frames;
+    track->samplerate = header->samplerate;
+    track->channels = header->channels;
+    track->mapping = mapping;
+    track->mapping_size = size;
+    return 0;
+}
+
+// Write a sidecar, under a temporary name first so a reader never maps half of one
+int pitch_track_save(const char *path, uint64_t source_key, uint64_t source_hash, int engine, uint32_t flags,
+                     const PitchTrack *track) {
+    PitchTrackHeader header;
+    pitch_track_header(&header, source_key, source_hash, engine, flags);
+    header.num_windows = (uint32_t)track->num_windows;
+    header.frames = track->frames;
+    header.samplerate = track->samplerate;
+    header.channels = track->channels;
+    
+    char temp[560];
+    snprintf(temp, sizeof(temp), "%s.%ld.%p.tmp", path, (long)getpid(), (const void*)track);
+    FILE *file = fopen(temp, "wb");
+    if (!file) return 1;
+    size_t points = (size_t)track->num_windows * track->voices;
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1 ||
+                 fwrite(track->points, sizeof(FrequencyPoint), points, file) != points;
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp, path) != 0) {
+        remove(temp);
+        return 1;
+    }
+    return 0;
+}
@@ -33,15 +33,401 @@ The json file looks like:
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <json-c/json.h>
+#include "whistler.h"
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <json_file>\n", argv[0]);
+// Post chain applied to every track before mixing (formerly
+// "sox ... rate 44100 reverb 40 50 40 echo 0.8 0.9 1000.0 0.3")
+#define CHORUS_SAMPLERATE 44100
+#define CHORUS_ECHO_GAIN_IN 0.8f
+#define CHORUS_ECHO_GAIN_OUT 0.9f
+#define CHORUS_ECHO_DELAY 1.0f     // Seconds
+#define CHORUS_ECHO_DECAY 0.3f
+
+// The mix bus: tracks are summed at gain / number of tracks, which leaves them
+// headroom, and the limiter catches whatever peaks still get over the ceiling
+#define CHORUS_LIMIT_CEILING 0.891f    // -1 dBFS
+#define CHORUS_LIMIT_LOOKAHEAD 0.005f  // Seconds
+#define CHORUS_LIMIT_RELEASE 0.08f     // Seconds
+
+// Render cache defaults
+#define CHORUS_CACHE_DIR "cache"
+#define CHORUS_CACHE_MB 1024
+
+// One track of the song. Once it's set up it's a stream, handed to the mixer a
+// block at a time: either its cached render read back, or its renderer run
+// through the post chain (resample to the mix rate, reverb, echo) and saved to
+// the cache as it goes. Nothing holds a whole track.
+typedef struct {
+    char input_file[256];
+    const char *instrument;     // As given in the JSON (for messages)
+    int transpose;
+    int volume;
+    float gain;                 // Level on the mix bus (optional "gain", default 1)
+    RenderOptions options;
+    uint64_t key;               // Render cache key (input contents + settings)
+    int state;                  // TRACK_PENDING, TRACK_READY, TRACK_DONE or TRACK_FAILED
+    
+    int channels;
+    sf_count_t frames;          // Length after the post chain
+    sf_count_t position;        // Frames handed to the mixer so far
+    float *block;               // This round's block for the mixer
+    int block_frames;
+    
+    SNDFILE *cached;            // Reading back a cached render, or NULL when rendering
+    
+    int rendering;              // The renderer and post chain below are set up
+    PitchTrack pitch;
+    Renderer renderer;
+    Resampler resampler;
+    Reverb *reverb;
+    Echo echo;
+    int stage;                  // CHAIN_RENDER, CHAIN_FLUSH, CHAIN_TAIL or CHAIN_END
+    float *rendered;            // One block from the renderer
+    float *pending;             // Post chain output not handed to the mixer yet
+    int pending_frames;
+    int storing;                // Writing the render to the cache
+    RenderCacheWriter store;
+} ChorusTrack;
+
+#define TRACK_PENDING 0
+#define TRACK_READY   1
+#define TRACK_DONE    2
+#define TRACK_FAILED  3
+
+// Where a rendering track's post chain is up to
+#define CHAIN_RENDER 0          // Feeding the renderer's output through
+#define CHAIN_FLUSH  1          // The renderer is done: the resampler's last frames
+#define CHAIN_TAIL   2          // The echo's tail
+#define CHAIN_END    3
+
+// Hands the tracks out to the worker threads, and the main thread, a round at a
+// time: the first round sets every track up, then each one fills every track's
+// next block
+typedef struct {
+    ChorusTrack *tracks;
+    int num_tracks;
+    const RenderCache *cache;   // NULL with --no-cache
+    int round;                  // 0 to set up, then one per block
+    int next;                   // Next track nobody has picked up this round
+    int remaining;              // Tracks of this round not finished yet
+    int failed;                 // A track failed part way through
+    int quit;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // A round has started, or it's time to quit
+    pthread_cond_t finished;    // The round's last track is done
+} Scheduler;
+
+// Cache key for a track: the input's contents plus everything that changes how
+// it's rendered and post-processed
+int track_cache_key(const ChorusTrack *track, uint64_t *key) {
+    uint64_t hash;
+    if (hash_file(track->input_file, &hash)) return 1;
+    
+    char settings[256];
+    int length = snprintf(settings, sizeof(settings),
+                          "engine=%d instrument=%d transpose=%d volume=%d control=%d "
+                          "rate=%d/sinc%d reverb=%g/%g echo=%g/%g/%g/%g",
+                          WHISTLER_ENGINE_VERSION, track->options.instrument, track->transpose,
+                          track->volume, track->options.control_block, CHORUS_SAMPLERATE, RESAMPLE_HALF_TAPS,
+                          REVERB_MIX, REVERB_DECAY, CHORUS_ECHO_GAIN_IN, CHORUS_ECHO_GAIN_OUT,
+                          CHORUS_ECHO_DELAY, CHORUS_ECHO_DECAY);
+    *key = fnv1a(hash, settings, length);
+    return 0;
+}
+
+// Let go of everything a track's stream holds except the mixer's block. A cache
+// entry still being written is thrown away.
+void close_track(ChorusTrack *track) {
+    if (track->cached) sf_close(track->cached);
+    track->cached = NULL;
+    if (track->rendering) {
+        renderer_free(&track->renderer);
+        pitch_track_free(&track->pitch);
+        resampler_free(&track->resampler);
+        reverb_destroy(track->reverb);
+        echo_free(&track->echo);
+        track->rendering = 0;
+    }
+    if (track->storing) render_cache_abort(&track->store);
+    track->storing = 0;
+    free(track->rendered);
+    free(track->pending);
+    track->rendered = NULL;
+    track->pending = NULL;
+}
+
+// Set a track up to stream: from the cache if its render is there, else analyse
+// its input and start the renderer and post chain
+int open_track(ChorusTrack *track, int index, const RenderCache *cache) {
+    int64_t start = profile_begin();
+    int cached = cache && track_cache_key(track, &track->key) == 0;
+    SF_INFO info;
+    track->cached = cached ? render_cache_read(cache, track->key, &info) : NULL;
+    profile_end(PROFILE_CACHE, start);
+    if (track->cached) {
+        printf("Track %d: reusing cached render of %s (%016llx)\n", index, track->input_file,
+               (unsigned long long)track->key);
+        track->channels = info.channels;
+        track->frames = info.frames;
+        track->block = (float*)malloc(sizeof(float) * STREAM_BLOCK * track->channels);
+        profile_alloc(PROFILE_MIX, sizeof(float) * STREAM_BLOCK * track->channels);
+        return track->block ? 0 : 1;
+    }
+    
+    printf("Rendering track %d: %s %d %s %d\n", index, track->input_file, track->transpose,
+           track->instrument, track->volume);
+    if (pitch_track_analyze(track->input_file, &track->options, &track->pitch)) {
+        return 1;
+    }
+    if (renderer_init(&track->renderer, &track->pitch, &track->options)) {
+        pitch_track_free(&track->pitch);
         return 1;
     }
+    track->rendering = 1;
+    
+    start = profile_begin();
+    int channels = track->pitch.channels;
+    track->channels = channels;
+    track->reverb = reverb_create(REVERB_MIX, REVERB_DECAY);
+    if (!track->reverb ||
+        resampler_init(&track->resampler, track->pitch.samplerate, CHORUS_SAMPLERATE, channels) ||
+        echo_init(&track->echo, channels, CHORUS_SAMPLERATE, CHORUS_ECHO_GAIN_IN, CHORUS_ECHO_GAIN_OUT,
+                  CHORUS_ECHO_DELAY, CHORUS_ECHO_DECAY)) {
+        return 1;
+    }
+    
+    // The echo adds its delay on the end so the last repeat isn't cut off
+    track->frames = resampler_output_frames(&track->resampler, track->renderer.frames) + track->echo.delay;
+    int chain_frames = resampler_max_output(&track->resampler, STREAM_BLOCK);
+    if (chain_frames < STREAM_BLOCK) chain_frames = STREAM_BLOCK;
+    track->rendered = (float*)malloc(sizeof(float) * STREAM_BLOCK * channels);
+    track->pending = (float*)malloc(sizeof(float) * (STREAM_BLOCK + chain_frames) * channels);
+    track->block = (float*)malloc(sizeof(float) * STREAM_BLOCK * channels);
+    profile_alloc(PROFILE_RESAMPLE, sizeof(float) * (2 * STREAM_BLOCK + chain_frames) * channels);
+    profile_alloc(PROFILE_MIX, sizeof(float) * STREAM_BLOCK * channels);
+    if (!track->rendered || !track->pending || !track->block) {
+        return 1;
+    }
+    profile_end(PROFILE_SETUP, start);
+    
+    if (cached) {
+        start = profile_begin();
+        if (render_cache_begin(cache, track->key, channels, CHORUS_SAMPLERATE, &track->store) == 0) {
+            track->storing = 1;
+        } else {
+            fprintf(stderr, "Warning: Could not save track %d to the render cache\n", index);
+        }
+        profile_end(PROFILE_CACHE, start);
+    }
+    return 0;
+}
+
+// Run the next piece of a rendering track through its post chain onto the end of
+// its pending frames. Returns the number of frames added, 0 once it's all out.
+int run_post_chain(ChorusTrack *track) {
+    int channels = track->channels;
+    float *out = track->pending + (sf_count_t)track->pending_frames * channels;
+    int frames = 0;
+    while (frames == 0 && track->stage != CHAIN_END) {
+        if (track->stage == CHAIN_RENDER) {
+            int rendered = renderer_render(&track->renderer, track->rendered, STREAM_BLOCK);
+            if (rendered > 0) {
+                int64_t start = profile_begin();
+                frames = resampler_process(&track->resampler, track->rendered, rendered, out);
+                profile_end(PROFILE_RESAMPLE, start);
+            } else {
+                track->stage = CHAIN_FLUSH;
+            }
+        } else if (track->stage == CHAIN_FLUSH) {
+            int64_t start = profile_begin();
+            frames = resampler_flush(&track->resampler, out, STREAM_BLOCK);
+            profile_end(PROFILE_RESAMPLE, start);
+            if (frames == 0) track->stage = CHAIN_TAIL;
+        } else {
+            // The tail is echo alone: the reverb ends with the track
+            int64_t start = profile_begin();
+            frames = echo_tail(&track->echo, out, STREAM_BLOCK);
+            profile_end(PROFILE_ECHO, start);
+            if (frames == 0) track->stage = CHAIN_END;
+            track->pending_frames += frames;
+            return frames;
+        }
+    }
+    int64_t start = profile_begin();
+    apply_reverb(track->reverb, out, frames, channels);
+    profile_end(PROFILE_REVERB, start);
+    start = profile_begin();
+    echo_process(&track->echo, out, frames);
+    profile_end(PROFILE_ECHO, start);
+    track->pending_frames += frames;
+    return frames;
+}
+
+// Fill a track's block with its next STREAM_BLOCK frames (fewer at the end). The
+// track closes once it's all been handed out.
+int next_track_block(ChorusTrack *track) {
+    int channels = track->channels;
+    sf_count_t remaining = track->frames - track->position;
+    int frames = remaining < STREAM_BLOCK ? (int)remaining : STREAM_BLOCK;
+    
+    if (track->cached) {
+        int64_t start = profile_begin();
+        sf_count_t got = sf_readf_float(track->cached, track->block, frames);
+        profile_end(PROFILE_DECODE, start);
+        if (got != frames) return 1;
+    } else {
+        while (track->pending_frames < frames) {
+            if (run_post_chain(track) == 0) return 1;  // Shorter than it should be
+        }
+        memcpy(track->block, track->pending, sizeof(float) * frames * channels);
+        track->pending_frames -= frames;
+        memmove(track->pending, track->pending + (sf_count_t)frames * channels,
+                sizeof(float) * track->pending_frames * channels);
+        int64_t start = profile_begin();
+        if (track->storing && render_cache_write(&track->store, track->block, frames)) {
+            render_cache_abort(&track->store);
+            track->storing = 0;
+        }
+        profile_end(PROFILE_ENCODE, start);
+    }
+    track->block_frames = frames;
+    track->position += frames;
+    
+    if (track->position == track->frames) {
+        int64_t start = profile_begin();
+        if (track->storing && render_cache_commit(&track->store)) {
+            fprintf(stderr, "Warning: Could not save %s to the render cache\n", track->input_file);
+        }
+        profile_end(PROFILE_CACHE, start);
+        track->storing = 0;
+        close_track(track);
+        track->state = TRACK_DONE;
+    }
+    return 0;
+}
+
+// Do this round's work on one track
+int run_track(Scheduler *scheduler, int index, int round) {
+    ChorusTrack *track = &scheduler->tracks[index];
+    if (round == 0) {
+        if (track->state == TRACK_PENDING) {
+            int failed = open_track(track, index, scheduler->cache);
+            if (failed) close_track(track);
+            track->state = failed ? TRACK_FAILED : TRACK_READY;
+        }
+        return 0;
+    }
+    track->block_frames = 0;
+    return track->state == TRACK_READY ? next_track_block(track) : 0;
+}
+
+// Take tracks from the current round until nobody needs to (called with the lock held)
+void scheduler_work(Scheduler *scheduler) {
+    while (scheduler->next < scheduler->num_tracks) {
+        int i = scheduler->next++;
+        int round = scheduler->round;
+        pthread_mutex_unlock(&scheduler->lock);
+        
+        profile_set_track(i);
+        int failed = run_track(scheduler, i, round);
+        profile_set_track(-1);
+        
+        pthread_mutex_lock(&scheduler->lock);
+        if (failed) {
+            fprintf(stderr, "Error: Track %d stopped short\n", i);
+            scheduler->failed = 1;
+        }
+        if (--scheduler->remaining == 0) {
+            pthread_cond_signal(&scheduler->finished);
+        }
+    }
+}
+
+// Worker thread: help with every round until told to quit
+void *render_worker(void *arg) {
+    Scheduler *scheduler = (Scheduler*)arg;
+    pthread_mutex_lock(&scheduler->lock);
+    for (;;) {
+        while (scheduler->next >= scheduler->num_tracks && !scheduler->quit) {
+            pthread_cond_wait(&scheduler->work, &scheduler->lock);
+        }
+        if (scheduler->quit) break;
+        scheduler_work(scheduler);
+    }
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
 
-    const char *json_file = argv[1];
+// Run a round over every track, with the calling thread joining in
+void scheduler_run_round(Scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->next = 0;
+    scheduler->remaining = scheduler->num_tracks;
+    pthread_cond_broadcast(&scheduler->work);
+    scheduler_work(scheduler);
+    while (scheduler->remaining > 0) {
+        pthread_cond_wait(&scheduler->finished, &scheduler->lock);
+    }
+    scheduler->round++;
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+void print_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [options] <json_file>\n", program_name);
+    fprintf(stderr, "  --jobs N: Number of tracks rendered at once (default: number of cores)\n");
+    fprintf(stderr, "  --cache-dir DIR: Where rendered tracks are cached (default: %s)\n", CHORUS_CACHE_DIR);
+    fprintf(stderr, "  --cache-size MB: Size the cache is trimmed to, least recently used first (default: %d)\n",
+            CHORUS_CACHE_MB);
+    fprintf(stderr, "  --no-cache: Render every track from scratch and leave the cache alone\n");
+    fprintf(stderr, "  --profile FILE: Write time and allocations per stage and per track to FILE as JSON\n");
+    fprintf(stderr, "  --profile-trace FILE: With --profile, also write every timed span to FILE as a\n");
+    fprintf(stderr, "             Chrome trace (open it in chrome://tracing or Perfetto)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int jobs = default_thread_count();
+    const char *cache_dir = CHORUS_CACHE_DIR;
+    long long cache_mb = CHORUS_CACHE_MB;
+    int use_cache = 1;
+    const char *profile_file = NULL;
+    const char *trace_file = NULL;
+    const char *json_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cache_mb = atoll(argv[++i]);
+            if (cache_mb < 0) {
+                fprintf(stderr, "Error: --cache-size must not be negative\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) {
+                fprintf(stderr, "Error: --jobs must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (!json_file) {
+            json_file = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!json_file || (trace_file && !profile_file)) {
+        print_usage(argv[0]);
+        return 1;
+    }
 
     // Open the JSON file
     FILE *file = fopen(json_file, "r");
@@ -97,24 +483,33 @@ int main(int argc, char *argv[]) {
     int num_tracks = json_object_array_length(tracks);
     printf("Number of tracks: %d\n", num_tracks);
 
-    //step 1, delete all files in the intermediate directory
-    char command[256];
-    snprintf(command, sizeof(command), "rm -f intermediate/*.wav");
-    printf("Executing: %s\n", command);
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error: Command failed with return code %d\n", result);
+    // Check every track up front, so a bad entry fails before any rendering
+    ChorusTrack *track_list = (ChorusTrack*)calloc(num_tracks > 0 ? num_tracks : 1, sizeof(ChorusTrack));
+    if (!track_list) {
+        fprintf(stderr, "Error: Could not allocate memory for the tracks\n");
         json_object_put(root);
         free(json_data);
         return 1;
     }
+    
+    if (profile_file && profile_init("chorus", num_tracks, trace_file != NULL)) {
+        fprintf(stderr, "Error: Could not allocate memory for the profile\n");
+        free(track_list);
+        json_object_put(root);
+        free(json_data);
+        return 1;
+    }
+    
+    // Share the cores out: tracks run side by side, each analysing on what's left
+    if (jobs > num_tracks) jobs = num_tracks > 0 ? num_tracks : 1;
+    int analysis_threads = default_thread_count() / jobs;
+    if (analysis_threads < 1) analysis_threads = 1;
 
-    // Iterate through the tracks - generating the songs by calling
-    // the whistler program
     for (int i = 0; i < num_tracks; i++) {
         json_object *track = json_object_array_get_idx(tracks, i);
         if (!json_object_is_type(track, json_type_object)) {
             fprintf(stderr, "Error: Track %d is not an object\n", i);
+            free(track_list);
             json_object_put(root);
             free(json_data);
             return 1;
@@ -125,77 +520,198 @@ int main(int argc, char *argv[]) {
         json_object *instrument = json_object_object_get(track, "instrument");
         json_object *transpose = json_object_object_get(track, "transpose");
         json_object *volume = json_object_object_get(track, "volume");
+        json_object *gain = json_object_object_get(track, "gain");
         
         if (!json_object_is_type(filename, json_type_string) ||
             !json_object_is_type(instrument, json_type_string) ||
             !json_object_is_type(transpose, json_type_int) ||
-            !json_object_is_type(volume, json_type_int)) {
+            !json_object_is_type(volume, json_type_int) ||
+            (gain && !json_object_is_type(gain, json_type_double) && !json_object_is_type(gain, json_type_int))) {
             fprintf(stderr, "Error: Invalid track format\n");
+            free(track_list);
             json_object_put(root);
             free(json_data);    
             return 1;
         }
 
-        // Get the values as strings
-        const char *filename_str = json_object_get_string(filename);
-        const char *instrument_str = json_object_get_string(instrument);    
-        int transpose_int = json_object_get_int(transpose);
-        int volume_int = json_object_get_int(volume);
-
-        // Construct the command line arguments
-        char command[256];
-        // Whistler commands look like:
-        // Usage: ./whistler <input_wav_file> [semitones] [instrument] [volume] [output_file]
+        ChorusTrack *t = &track_list[i];
+        t->instrument = json_object_get_string(instrument);
+        t->transpose = json_object_get_int(transpose);
+        t->volume = json_object_get_int(volume);
+        t->gain = gain ? (float)json_object_get_double(gain) : 1.0f;
         //input wav file is in "samples" directory
-        char input_file[256];
-        snprintf(input_file, sizeof(input_file), "samples/%s", filename_str);
-        //output wav is in "intermediate" directory - you can use i as the file name
-        char output_file[256];
-        snprintf(output_file, sizeof(output_file), "intermediate/%d.wav", i);
+        snprintf(t->input_file, sizeof(t->input_file), "samples/%s", json_object_get_string(filename));
+        
+        char name[512];
+        snprintf(name, sizeof(name), "%s %s %d", t->input_file, t->instrument, t->transpose);
+        profile_set_track_name(i, name);
 
-        //call the whistler program
-        snprintf(command, sizeof(command), "./whistler %s %d %s %d %s", input_file, transpose_int, instrument_str, volume_int, output_file);
-        printf("Executing: %s\n", command);
-        int result = system(command);
-        if (result != 0) {
-            fprintf(stderr, "Error: Command failed with return code %d\n", result);
+        render_options_init(&t->options);
+        t->options.instrument = get_instrument_by_name(t->instrument);
+        t->options.transpose = (float)t->transpose;
+        t->options.volume = (float)t->volume;
+        t->options.threads = analysis_threads;
+        if (t->options.instrument < 0) {
+            fprintf(stderr, "Error: Unknown instrument name: %s\n", t->instrument);
+            t->state = TRACK_FAILED;  // Skipped, like a track that fails to render
         }
     }
 
-    // now that we've generated intermediate/0...(n-1).wav files, use sox to mix them together 
-    // and output to output/<song_name>.wav
+    // Set the tracks up and render them on `jobs` threads: this one and jobs - 1 workers
+    Scheduler scheduler;
+    memset(&scheduler, 0, sizeof(scheduler));
+    scheduler.tracks = track_list;
+    scheduler.num_tracks = num_tracks;
+    scheduler.next = num_tracks;    // Nothing to pick up until the first round
+    
+    RenderCache cache;
+    if (use_cache) {
+        if (render_cache_open(&cache, cache_dir, cache_mb * 1024 * 1024) == 0) {
+            scheduler.cache = &cache;
+        } else {
+            fprintf(stderr, "Warning: Could not use %s as the render cache\n", cache_dir);
+        }
+    }
+    pthread_mutex_init(&scheduler.lock, NULL);
+    pthread_cond_init(&scheduler.work, NULL);
+    pthread_cond_init(&scheduler.finished, NULL);
+    
+    printf("Rendering on %d job%s\n", jobs, jobs == 1 ? "" : "s");
+    pthread_t workers[jobs];
+    int started = 0;
+    for (int j = 1; j < jobs; j++) {
+        if (pthread_create(&workers[started], NULL, render_worker, &scheduler) == 0) {
+            started++;
+        }
+    }
+    scheduler_run_round(&scheduler);
+    
+    int channels = 1;
+    sf_count_t frames = 0;
+    for (int i = 0; i < num_tracks; i++) {
+        ChorusTrack *t = &track_list[i];
+        if (t->state == TRACK_FAILED) {
+            fprintf(stderr, "Error: Could not render track %d\n", i);
+            continue;
+        }
+        if (t->channels > channels) channels = t->channels;
+        if (t->frames > frames) frames = t->frames;
+    }
+
+    // Write the mix to output/<song_name>.wav
     char output_file[256];
     snprintf(output_file, sizeof(output_file), "output/%s.wav", song_name_str);
+    printf("Writing mix to: %s\n", output_file);
+
+    SF_INFO outinfo;
+    memset(&outinfo, 0, sizeof(outinfo));
+    outinfo.samplerate = CHORUS_SAMPLERATE;
+    outinfo.channels = channels;
+    outinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+
+    SNDFILE *outfile = sf_open(output_file, SFM_WRITE, &outinfo);
+    Limiter limiter;
+    float *bus = NULL;
+    float *out = NULL;
+    int failed = !outfile;
+    if (!outfile) {
+        fprintf(stderr, "Error: Could not open output file %s: %s\n", output_file, sf_strerror(NULL));
+    } else if (limiter_init(&limiter, channels, CHORUS_SAMPLERATE, CHORUS_LIMIT_CEILING,
+                            CHORUS_LIMIT_LOOKAHEAD, CHORUS_LIMIT_RELEASE)) {
+        fprintf(stderr, "Error: Could not allocate memory for the mix\n");
+        failed = 1;
+    } else {
+        int block_frames = limiter.lookahead > STREAM_BLOCK ? limiter.lookahead : STREAM_BLOCK;
+        bus = (float*)malloc(sizeof(float) * STREAM_BLOCK * channels);
+        out = (float*)malloc(sizeof(float) * block_frames * channels);
+        profile_alloc(PROFILE_MIX, sizeof(float) * STREAM_BLOCK * channels);
+        profile_alloc(PROFILE_LIMITER, sizeof(float) * block_frames * channels);
+        if (!bus || !out) {
+            fprintf(stderr, "Error: Could not allocate memory for the mix\n");
+            failed = 1;
+        }
+    }
     
-    // First, resample all files to 44100 Hz
-    for (int i = 0; i < num_tracks; i++) {
-        char input_file[256];
-        char resampled_file[256];
-        snprintf(input_file, sizeof(input_file), "intermediate/%d.wav", i);
-        snprintf(resampled_file, sizeof(resampled_file), "intermediate/%d_resampled.wav", i);
+    // Every track's next block, in lockstep, summed in song order so the output is
+    // the same however the jobs were scheduled, then limited and written straight out
+    for (sf_count_t position = 0; !failed && position < frames; position += STREAM_BLOCK) {
+        scheduler_run_round(&scheduler);
+        if (scheduler.failed) {
+            failed = 1;
+            break;
+        }
         
-        snprintf(command, sizeof(command), "sox %s %s rate 44100 reverb 40 50 40 echo 0.8 0.9 1000.0 0.3", input_file, resampled_file);
-        printf("Executing: %s\n", command);
-        result = system(command);
-        if (result != 0) {
-            fprintf(stderr, "Error: Command failed with return code %d\n", result);
+        sf_count_t remaining = frames - position;
+        int block = remaining < STREAM_BLOCK ? (int)remaining : STREAM_BLOCK;
+        int64_t start = profile_begin();
+        memset(bus, 0, sizeof(float) * block * channels);
+        for (int i = 0; i < num_tracks; i++) {
+            ChorusTrack *t = &track_list[i];
+            if (t->state == TRACK_FAILED || t->block_frames == 0) continue;
+            mix_block_add(bus, channels, t->block, t->channels, t->block_frames, t->gain / num_tracks);
+        }
+        profile_end(PROFILE_MIX, start);
+        start = profile_begin();
+        int limited = limiter_process(&limiter, bus, out, block);
+        profile_end(PROFILE_LIMITER, start);
+        start = profile_begin();
+        if (sf_writef_float(outfile, out, limited) != limited) {
+            fprintf(stderr, "Error: Could not write to %s\n", output_file);
+            failed = 1;
+        }
+        profile_end(PROFILE_ENCODE, start);
+    }
+    if (!failed) {
+        int64_t start = profile_begin();
+        int limited = limiter_flush(&limiter, out);
+        profile_end(PROFILE_LIMITER, start);
+        start = profile_begin();
+        if (limited < 0 || sf_writef_float(outfile, out, limited) != limited) {
+            fprintf(stderr, "Error: Could not write to %s\n", output_file);
+            failed = 1;
         }
+        profile_end(PROFILE_ENCODE, start);
+    }
+    
+    pthread_mutex_lock(&scheduler.lock);
+    scheduler.quit = 1;
+    pthread_cond_broadcast(&scheduler.work);
+    pthread_mutex_unlock(&scheduler.lock);
+    for (int j = 0; j < started; j++) {
+        pthread_join(workers[j], NULL);
     }
+    pthread_mutex_destroy(&scheduler.lock);
+    pthread_cond_destroy(&scheduler.work);
+    pthread_cond_destroy(&scheduler.finished);
     
-    // Then mix all resampled files
-    snprintf(command, sizeof(command), "sox -m intermediate/*_resampled.wav %s", output_file);
-    printf("Executing: %s\n", command);
-    result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error: Command failed with return code %d\n", result);
+    if (outfile) {
+        int64_t start = profile_begin();
+        sf_close(outfile);
+        profile_end(PROFILE_ENCODE, start);
+        limiter_free(&limiter);
+    }
+    free(bus);
+    free(out);
+    for (int i = 0; i < num_tracks; i++) {
+        close_track(&track_list[i]);
+        free(track_list[i].block);
+    }
+    if (scheduler.cache) {
+        int64_t start = profile_begin();
+        render_cache_evict(scheduler.cache);
+        profile_end(PROFILE_CACHE, start);
+    }
+    if (profile_file) {
+        if (profile_write(profile_file, trace_file) == 0) {
+            printf("Wrote profile to %s%s%s\n", profile_file, trace_file ? " and trace to " : "",
+                   trace_file ? trace_file : "");
+        } else {
+            fprintf(stderr, "Warning: Could not write the profile to %s\n", profile_file);
+        }
+        profile_free();
     }
- 
+    free(track_list);
     json_object_put(root);
     free(json_data);
-
-    return 0;
+    return failed;
 }
-
-        
-        
-        
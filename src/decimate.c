@@ -0,0 +1,169 @@
+// decimate.c - decimated peak engine: the analysis channel is low-pass filtered and
+// decimated (a polyphase FIR that only computes the outputs it keeps) down to a rate
+// just above the pitch range, then windowed and peak-picked as by the peak engine.
+// A window of WINDOW_SIZE / decimation samples spans the same time as a full-rate
+// window, so the bins are spaced exactly as before for a fraction of the transform.
+#include "whistler.h"
+#ifdef __SSE2__
+    #include <immintrin.h>  // SSE2 filter taps
+#endif
+
+// Per-thread state. Each batch of windows is copied out of the input into `input`
+// with the `half` frames either side that the filter reaches, filtered down into
+// `decimated` and handed to the peak picker. Those guard frames come from the input
+// wherever it has them, so a decimated sample is the same whichever batch (or
+// thread, or live pull) computes it; only the ends of the input are padded with
+// silence.
+typedef struct {
+    int decimation;         // Input frames per decimated sample (divides the hop)
+    int half;               // Taps each side of the centre tap (input frames)
+    int taps;               // 2 * half + 1, rounded up to a multiple of four with zero taps
+    int howmany;            // Windows per batch
+    float *coeffs;          // Low-pass filter taps
+    float *input;           // Batch span + taps frames of the channel, from frame -half
+    float *decimated;       // Batch span / decimation samples
+    FFTContext *fft;
+} DecimatedContext;
+
+// Largest power of two decimation (up to HOP_SIZE) that leaves the rate at or
+// above DECIMATE_MIN_RATE; 1 if the input is already that low
+int decimation_factor(int samplerate) {
+    int factor = 1;
+    while (factor * 2 <= HOP_SIZE && samplerate / (float)(factor * 2) >= DECIMATE_MIN_RATE) {
+        factor *= 2;
+    }
+    return factor;
+}
+
+// The filter reaches `half` frames past the end of the window
+int decimated_engine_lookahead(int samplerate) {
+    return WINDOW_SIZE + DECIMATE_HALF_TAPS * decimation_factor(samplerate);
+}
+
+void decimated_engine_destroy(void *state) {
+    DecimatedContext *dec = (DecimatedContext*)state;
+    if (!dec) return;
+    fft_context_destroy(dec->fft);
+    fftwf_free(dec->coeffs);
+    fftwf_free(dec->input);
+    fftwf_free(dec->decimated);
+    free(dec);
+}
+
+void *decimated_engine_create(int samplerate, int batch, unsigned planner_flags) {
+    DecimatedContext *dec = (DecimatedContext*)calloc(1, sizeof(DecimatedContext));
+    if (!dec) return NULL;
+
+    // Room for a batch at the widest hop an engine is asked for
+    int factor = decimation_factor(samplerate);
+    int span = (batch - 1) * ADAPTIVE_HOPS * HOP_SIZE + WINDOW_SIZE;
+    dec->decimation = factor;
+    dec->half = DECIMATE_HALF_TAPS * factor;
+    dec->taps = (2 * dec->half + 1 + 3) & ~3;
+    dec->howmany = batch;
+    dec->fft = fft_context_create(WINDOW_SIZE / factor, batch, samplerate, planner_flags);
+    if (factor > 1) {
+        dec->coeffs = (float*) fftwf_malloc(sizeof(float) * dec->taps);
+        dec->input = (float*) fftwf_malloc(sizeof(float) * (span + dec->taps));
+        dec->decimated = (float*) fftwf_malloc(sizeof(float) * (span / factor));
+        profile_alloc(PROFILE_ANALYSIS, sizeof(DecimatedContext) + sizeof(float) * dec->taps +
+                      sizeof(float) * (span + dec->taps) + sizeof(float) * (span / factor));
+        if (!dec->coeffs || !dec->input || !dec->decimated) {
+            decimated_engine_destroy(dec);
+            return NULL;
+        }
+    }
+    if (!dec->fft) {
+        decimated_engine_destroy(dec);
+        return NULL;
+    }
+    if (factor == 1) return dec;  // Nothing to filter: this is the peak engine
+
+    // Kaiser-windowed sinc cut off at the decimated Nyquist, normalised to unity
+    // gain at DC. Its transition band sits between MAX_FREQUENCY and the lowest
+    // frequency that folds back onto MAX_FREQUENCY.
+    double cutoff = 0.5 / factor;   // Cycles per input frame
+    double window_scale = 1.0 / bessel_i0(DECIMATE_KAISER_BETA);
+    double sum = 0.0;
+    for (int t = 0; t < dec->taps; t++) {
+        double distance = t - dec->half;
+        double x = distance / (dec->half + 1);
+        double window = x * x < 1.0 ? bessel_i0(DECIMATE_KAISER_BETA * sqrt(1.0 - x * x)) * window_scale : 0.0;
+        double sinc = distance == 0.0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * distance) / (M_PI * distance);
+        dec->coeffs[t] = t <= 2 * dec->half ? (float)(sinc * window) : 0.0f;
+        sum += dec->coeffs[t];
+    }
+    for (int t = 0; t < dec->taps; t++) {
+        dec->coeffs[t] = (float)(dec->coeffs[t] / sum);
+    }
+
+    // The full-rate Hann window at the kept frames. Each decimated sample stands in
+    // for `factor` full-rate ones, so scaling by it keeps amplitudes on the peak
+    // engine's scale (and AMP_THRESHOLD meaning the same).
+    for (int i = 0; i < dec->fft->n; i++) {
+        dec->fft->hann[i] = 0.5 * (1 - cosf(2 * M_PI * (i * factor) / (WINDOW_SIZE - 1))) * factor;
+    }
+    dec->fft->decimation = factor;
+
+    memset(dec->input, 0, sizeof(float) * (span + dec->taps));
+    return dec;
+}
+
+// One decimated sample: the filter over taps consecutive input frames
+static inline float filter_tap(const float *x, const float *coeffs, int taps) {
+    int t = 0;
+    float sum = 0.0f;
+#ifdef __SSE2__
+    __m128 acc = _mm_setzero_ps();
+    for (; t + 4 <= taps; t += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + t), _mm_load_ps(coeffs + t)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+    sum = _mm_cvtss_f32(acc);
+#endif
+    for (; t < taps; t++) {
+        sum += x[t] * coeffs[t];
+    }
+    return sum;
+}
+
+// Analyse `count` consecutive hop windows (laid out as for the peak picker)
+void decimated_engine_analyze(void *state, const float *samples, int stride, int hop, int count, int before,
+                              int after, FrequencyPoint *peaks) {
+    DecimatedContext *dec = (DecimatedContext*)state;
+    if (dec->decimation == 1) {
+        analyze_windows(dec->fft, samples, stride, hop, count, peaks);
+        return;
+    }
+    int factor = dec->decimation;
+    int half = dec->half;
+    int end = (count - 1) * hop + WINDOW_SIZE + (after < half ? after : half);  // Past the last real frame
+
+    for (int first = 0; first < count; first += dec->howmany) {
+        int batch = count - first < dec->howmany ? count - first : dec->howmany;
+        int span = (batch - 1) * hop + WINDOW_SIZE;
+
+        // The batch's frames and `half` either side: from the input where there are
+        // any (the windows before and after, or what the caller says lies beyond
+        // them), silence where there aren't
+        int offset = first * hop;
+        int lead = offset + before < half ? offset + before : half;
+        int tail = end - offset - span < half ? end - offset - span : half;
+        const float *src = samples + (sf_count_t)offset * stride;
+        float *x = dec->input + half;
+        memset(dec->input, 0, sizeof(float) * (half - lead));
+        for (int i = -lead; i < span + tail; i++) {
+            x[i] = src[(sf_count_t)i * stride];
+        }
+        memset(x + span + tail, 0, sizeof(float) * (dec->taps - half - tail));
+
+        // Only the kept outputs are computed: decimated sample j is centred on frame j * factor
+        int outputs = span / factor;
+        for (int j = 0; j < outputs; j++) {
+            dec->decimated[j] = filter_tap(dec->input + (sf_count_t)j * factor, dec->coeffs, dec->taps);
+        }
+
+        analyze_windows(dec->fft, dec->decimated, 1, hop / factor, batch, peaks + first);
+    }
+}
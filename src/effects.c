@@ -0,0 +1,347 @@
+// effects.c - reverb, chorus, echo and the limiter on the mix bus
+#include "whistler.h"
+#ifdef __SSE2__
+    #include <immintrin.h>  // SSE2 for the reverb, four frames at a time
+#endif
+
+void reverb_destroy(Reverb *reverb) {
+    free(reverb);
+}
+
+Reverb *reverb_create(float mix, float decay) {
+    Reverb *reverb = (Reverb*)calloc(1, sizeof(Reverb));
+    profile_alloc(PROFILE_REVERB, sizeof(Reverb));
+    if (!reverb) {
+        printf("Failed to allocate memory for reverb\n");
+        return NULL;
+    }
+    reverb->mix = mix;
+    reverb->decay = decay;
+    reverb->delay_lengths[0] = REVERB_DELAY1;
+    reverb->delay_lengths[1] = REVERB_DELAY2;
+    reverb->delay_lengths[2] = REVERB_DELAY3;
+    reverb->delay_lengths[3] = REVERB_DELAY4;
+    return reverb;
+}
+
+// Feed `frames` frames of mono input through the delay network, writing half the
+// lines' sum to wet. No ring index may wrap inside the run (see apply_reverb).
+//
+// Each line's output is what went into it `delay` frames ago; the outputs are
+// mixed by a Householder matrix (x - sum(x) / 2, which is orthogonal, so the loop
+// only loses what `decay` takes) and go back in with the input. Every line feeds
+// every other, which builds echo density far faster than four separate combs.
+static void reverb_run(Reverb *reverb, const float *input, float *wet, int frames,
+                       unsigned write, const unsigned *read) {
+    float decay = reverb->decay;
+    const float *out0 = reverb->ring[0] + read[0];
+    const float *out1 = reverb->ring[1] + read[1];
+    const float *out2 = reverb->ring[2] + read[2];
+    const float *out3 = reverb->ring[3] + read[3];
+    float *in0 = reverb->ring[0] + write;
+    float *in1 = reverb->ring[1] + write;
+    float *in2 = reverb->ring[2] + write;
+    float *in3 = reverb->ring[3] + write;
+    int i = 0;
+    
+#ifdef __SSE2__
+    // Four frames at a time: a run is shorter than the shortest delay, so none of
+    // its frames reads what another of them writes
+    __m128 vdecay = _mm_set1_ps(decay);
+    __m128 vhalf = _mm_set1_ps(0.5f);
+    __m128 vquarter = _mm_set1_ps(0.25f);
+    for (; i + 4 <= frames; i += 4) {
+        __m128 x0 = _mm_loadu_ps(out0 + i);
+        __m128 x1 = _mm_loadu_ps(out1 + i);
+        __m128 x2 = _mm_loadu_ps(out2 + i);
+        __m128 x3 = _mm_loadu_ps(out3 + i);
+        __m128 sum = _mm_add_ps(_mm_add_ps(x0, x1), _mm_add_ps(x2, x3));
+        __m128 half = _mm_mul_ps(sum, vhalf);
+        __m128 dry = _mm_mul_ps(_mm_loadu_ps(input + i), vquarter);
+        _mm_storeu_ps(in0 + i, _mm_add_ps(dry, _mm_mul_ps(_mm_sub_ps(x0, half), vdecay)));
+        _mm_storeu_ps(in1 + i, _mm_add_ps(dry, _mm_mul_ps(_mm_sub_ps(x1, half), vdecay)));
+        _mm_storeu_ps(in2 + i, _mm_add_ps(dry, _mm_mul_ps(_mm_sub_ps(x2, half), vdecay)));
+        _mm_storeu_ps(in3 + i, _mm_add_ps(dry, _mm_mul_ps(_mm_sub_ps(x3, half), vdecay)));
+        _mm_storeu_ps(wet + i, half);
+    }
+#endif
+    // Same operations in the same order as above
+    for (; i < frames; i++) {
+        float x0 = out0[i], x1 = out1[i], x2 = out2[i], x3 = out3[i];
+        float half = ((x0 + x1) + (x2 + x3)) * 0.5f;
+        float dry = input[i] * 0.25f;
+        in0[i] = dry + (x0 - half) * decay;
+        in1[i] = dry + (x1 - half) * decay;
+        in2[i] = dry + (x2 - half) * decay;
+        in3[i] = dry + (x3 - half) * decay;
+        wet[i] = half;
+    }
+}
+
+// Run the next `length` frames through the reverb in place, REVERB_CHUNK frames
+// at a time. Each frame only needs its own dry value, so no copy of the dry
+// signal is kept.
+void apply_reverb(Reverb *reverb, float *buffer, int length, int channels) {
+    float mix = reverb->mix;
+    float input[REVERB_CHUNK];
+    float wet[REVERB_CHUNK];
+    
+    for (int start = 0; start < length; start += REVERB_CHUNK) {
+        int frames = length - start < REVERB_CHUNK ? length - start : REVERB_CHUNK;
+        float *chunk = buffer + (sf_count_t)start * channels;
+        
+        // Get the current sample (average of all channels)
+        for (int i = 0; i < frames; i++) {
+            float sum = 0;
+            for (int ch = 0; ch < channels; ch++) {
+                sum += chunk[i * channels + ch];
+            }
+            input[i] = sum / channels;
+        }
+        
+        // Through the network in runs that stop wherever a ring index wraps
+        for (int i = 0; i < frames;) {
+            int run = frames - i;
+            unsigned write = (reverb->position + i) & REVERB_RING_MASK;
+            if (REVERB_RING - write < (unsigned)run) run = REVERB_RING - write;
+            unsigned read[4];
+            for (int j = 0; j < 4; j++) {
+                read[j] = (reverb->position + i - reverb->delay_lengths[j]) & REVERB_RING_MASK;
+                if (REVERB_RING - read[j] < (unsigned)run) run = REVERB_RING - read[j];
+            }
+            reverb_run(reverb, input + i, wet + i, run, write, read);
+            i += run;
+        }
+        reverb->position += frames;
+        
+        // Mix dry and wet signals
+        for (int i = 0; i < frames; i++) {
+            float w = wet[i] * mix;
+            for (int ch = 0; ch < channels; ch++) {
+                chunk[i * channels + ch] = chunk[i * channels + ch] * (1.0f - mix) + w;
+            }
+        }
+    }
+}
+
+int chorus_init(Chorus *chorus, int samplerate, float mix) {
+    memset(chorus, 0, sizeof(Chorus));
+    chorus->mix = mix;
+    int max_delay = (int)(CHORUS_MAX_DELAY * samplerate) + 4;  // Plus the interpolator's reach
+    int ring_size = 1;
+    while (ring_size <= max_delay) ring_size <<= 1;
+    chorus->ring = (float*)calloc(ring_size, sizeof(float));
+    profile_alloc(PROFILE_CHORUS, ring_size * sizeof(float));
+    chorus->mask = ring_size - 1;
+    return chorus->ring ? 0 : 1;
+}
+
+void chorus_free(Chorus *chorus) {
+    free(chorus->ring);
+    chorus->ring = NULL;
+}
+
+// Chorus `frames` frames in place: each comes out as dry * (1 - mix) plus the
+// input from delay[n] frames earlier * mix. The delay is fractional and read with
+// a 4-point Hermite interpolator, so a sweeping delay glides instead of stepping
+// a whole sample at a time. Delays must be at least 2 frames.
+void chorus_process(Chorus *chorus, float *buffer, const float *delay, int frames) {
+    float mix = chorus->mix;
+    float *ring = chorus->ring;
+    int mask = chorus->mask;
+    unsigned position = chorus->position;
+    
+    for (int n = 0; n < frames; n++, position++) {
+        float sample = buffer[n];
+        ring[position & mask] = sample;
+        
+        float d = delay[n];
+        int whole = (int)d;
+        float frac = d - whole;
+        
+        // Points either side of the read position, oldest first: x0 x1 [read] x2 x3
+        unsigned read = position - whole;
+        float x0 = ring[(read - 2) & mask];
+        float x1 = ring[(read - 1) & mask];
+        float x2 = ring[read & mask];
+        float x3 = ring[(read + 1) & mask];
+        
+        // Going back `frac` from x2 towards x1
+        float t = 1.0f - frac;
+        float c1 = 0.5f * (x2 - x0);
+        float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+        float c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+        float delayed = ((c3 * t + c2) * t + c1) * t + x1;
+        
+        buffer[n] = sample * (1.0f - mix) + delayed * mix;
+    }
+    chorus->position = position;
+}
+
+// Single-tap echo fed a block at a time: out = (in * gain_in + in delayed * decay) * gain_out.
+// Once the input ends, echo_tail() gives the last `delay` frames of echo.
+int echo_init(Echo *echo, int channels, int samplerate, float gain_in, float gain_out,
+              float delay_secs, float decay) {
+    memset(echo, 0, sizeof(Echo));
+    echo->channels = channels;
+    echo->delay = (int)(delay_secs * samplerate);
+    echo->gain_in = gain_in;
+    echo->gain_out = gain_out;
+    echo->decay = decay;
+    echo->ring = (float*)calloc(echo->delay > 0 ? (size_t)echo->delay * channels : 1, sizeof(float));
+    profile_alloc(PROFILE_ECHO, (size_t)echo->delay * channels * sizeof(float));
+    return echo->ring ? 0 : 1;
+}
+
+void echo_free(Echo *echo) {
+    free(echo->ring);
+    echo->ring = NULL;
+}
+
+void echo_process(Echo *echo, float *buffer, int frames) {
+    int channels = echo->channels;
+    for (int i = 0; i < frames; i++) {
+        float *frame = buffer + (sf_count_t)i * channels;
+        if (echo->delay == 0) {
+            for (int ch = 0; ch < channels; ch++) {
+                frame[ch] = (frame[ch] * echo->gain_in + frame[ch] * echo->decay) * echo->gain_out;
+            }
+            continue;
+        }
+        
+        // The ring slot holds the input from `delay` frames ago; the new input replaces it
+        float *delayed = echo->ring + (sf_count_t)echo->position * channels;
+        for (int ch = 0; ch < channels; ch++) {
+            float dry = frame[ch];
+            frame[ch] = (dry * echo->gain_in + delayed[ch] * echo->decay) * echo->gain_out;
+            delayed[ch] = dry;
+        }
+        if (++echo->position == echo->delay) echo->position = 0;
+    }
+}
+
+// After the last input block: up to max_frames more of the echo's tail into out.
+// Returns the number of frames, 0 once the whole tail has been given.
+int echo_tail(Echo *echo, float *out, int max_frames) {
+    int frames = echo->delay - echo->tail_done;
+    if (frames > max_frames) frames = max_frames;
+    if (frames <= 0) return 0;
+    memset(out, 0, sizeof(float) * frames * echo->channels);
+    echo_process(echo, out, frames);
+    echo->tail_done += frames;
+    return frames;
+}
+
+// Look-ahead peak limiter for the mix bus. Each frame's gain is the lowest any frame
+// in the next `lookahead` needs to stay under the ceiling, box-averaged over
+// `lookahead` frames so it ramps down in time for the peak without a click, and
+// released exponentially. Below the ceiling the gain is exactly 1, so a mix that
+// doesn't need limiting passes through unchanged (just delayed, see below).
+int limiter_init(Limiter *limiter, int channels, int samplerate, float ceiling, float lookahead_secs,
+                 float release_secs) {
+    memset(limiter, 0, sizeof(Limiter));
+    limiter->channels = channels;
+    limiter->ceiling = ceiling;
+    limiter->lookahead = (int)(lookahead_secs * samplerate);
+    if (limiter->lookahead < 1) limiter->lookahead = 1;
+    limiter->release = 1.0f - expf(-1.0f / (release_secs * samplerate));
+    limiter->gain = 1.0f;
+    
+    int lookahead = limiter->lookahead;
+    limiter->delay = (float*)calloc((size_t)lookahead * channels, sizeof(float));
+    limiter->held = (float*)malloc(lookahead * sizeof(float));
+    limiter->min_frame = (sf_count_t*)malloc((lookahead + 1) * sizeof(sf_count_t));
+    limiter->min_target = (float*)malloc((lookahead + 1) * sizeof(float));
+    profile_alloc(PROFILE_LIMITER, (size_t)lookahead * (channels + 1) * sizeof(float) +
+                  (lookahead + 1) * (sizeof(sf_count_t) + sizeof(float)));
+    if (!limiter->delay || !limiter->held || !limiter->min_frame || !limiter->min_target) {
+        limiter_free(limiter);
+        return 1;
+    }
+    for (int i = 0; i < lookahead; i++) limiter->held[i] = 1.0f;
+    limiter->held_sum = lookahead;
+    return 0;
+}
+
+void limiter_free(Limiter *limiter) {
+    free(limiter->delay);
+    free(limiter->held);
+    free(limiter->min_frame);
+    free(limiter->min_target);
+    limiter->delay = NULL;
+    limiter->held = NULL;
+    limiter->min_frame = NULL;
+    limiter->min_target = NULL;
+}
+
+// Limit `frames` frames of `in` into `out`. Output runs `lookahead` frames behind
+// the input, so the first call(s) give fewer frames; limiter_flush() gives the
+// rest. Returns the number of frames written to out.
+int limiter_process(Limiter *limiter, const float *in, float *out, int frames) {
+    int channels = limiter->channels;
+    int lookahead = limiter->lookahead;
+    int window = lookahead + 1;     // Deque capacity: targets of frames f - lookahead .. f
+    int written = 0;
+    
+    for (int i = 0; i < frames; i++) {
+        const float *frame = in + (sf_count_t)i * channels;
+        sf_count_t f = limiter->frames_in++;
+        
+        float peak = 0.0f;
+        for (int ch = 0; ch < channels; ch++) {
+            float level = fabsf(frame[ch]);
+            if (level > peak) peak = level;
+        }
+        float target = peak > limiter->ceiling ? limiter->ceiling / peak : 1.0f;
+        
+        // Sliding minimum of the targets over [f - lookahead, f] (a monotonic deque)
+        while (limiter->min_count > 0) {
+            int back = (limiter->min_head + limiter->min_count - 1) % window;
+            if (limiter->min_target[back] < target) break;
+            limiter->min_count--;
+        }
+        int slot = (limiter->min_head + limiter->min_count) % window;
+        limiter->min_frame[slot] = f;
+        limiter->min_target[slot] = target;
+        limiter->min_count++;
+        if (limiter->min_frame[limiter->min_head] < f - lookahead) {
+            limiter->min_head = (limiter->min_head + 1) % window;
+            limiter->min_count--;
+        }
+        float held = limiter->min_target[limiter->min_head];
+        
+        // Box average of the held minimum, then the release
+        int position = (int)(f % lookahead);
+        limiter->held_sum += (double)held - limiter->held[position];
+        limiter->held[position] = held;
+        float average = (float)(limiter->held_sum / lookahead);
+        float released = limiter->gain + (1.0f - limiter->gain) * limiter->release;
+        limiter->gain = average < released ? average : released;
+        
+        // The frame `lookahead` behind this one goes out with the gain; this one waits
+        float *delayed = limiter->delay + (sf_count_t)position * channels;
+        if (f >= lookahead) {
+            float *dst = out + (sf_count_t)written * channels;
+            for (int ch = 0; ch < channels; ch++) {
+                dst[ch] = delayed[ch] * limiter->gain;
+            }
+            written++;
+        }
+        memcpy(delayed, frame, sizeof(float) * channels);
+    }
+    return written;
+}
+
+// The input has ended: write the last `lookahead` frames (out must hold them all)
+int limiter_flush(Limiter *limiter, float *out) {
+    int channels = limiter->channels;
+    float *silence = (float*)calloc((size_t)limiter->lookahead * channels, sizeof(float));
+    if (!silence) return -1;
+    
+    // Any frames the input never reached (a song shorter than the look-ahead) don't exist
+    sf_count_t frames_in = limiter->frames_in;
+    int written = limiter_process(limiter, silence, out, limiter->lookahead);
+    free(silence);
+    sf_count_t owed = frames_in < limiter->lookahead ? frames_in : limiter->lookahead;
+    return written < owed ? written : (int)owed;
+}
@@ -0,0 +1,151 @@
+// live.c - render input as it arrives (a microphone, a pipe) with bounded latency,
+// tracking pitch hop by hop and running the synth as far as the track allows
+#include "whistler.h"
+
+int live_renderer_init(LiveRenderer *live, const RenderOptions *options, int samplerate, int channels) {
+    memset(live, 0, sizeof(LiveRenderer));
+    live->options = *options;
+    live->samplerate = samplerate;
+    live->channels = channels;
+    
+    // Planning happens here, before any audio flows
+    if (pitch_tracker_init(&live->tracker, options->pitch_engine, samplerate, LIVE_ANALYSIS_BATCH,
+                           options->fft_planner)) {
+        fprintf(stderr, "Failed to create FFT plan\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Set the synth up on the points so far. Its length isn't known yet, so the note
+// is held open (and the last window never reached) until finish().
+static int live_renderer_start(LiveRenderer *live) {
+    PitchTrack track;
+    memset(&track, 0, sizeof(PitchTrack));
+    track.points = live->points;
+    track.num_windows = live->num_points;
+    track.voices = 1;
+    track.frames = INT64_MAX;
+    track.samplerate = live->samplerate;
+    track.channels = live->channels;
+    if (renderer_init(&live->renderer, &track, &live->options)) {
+        return 1;
+    }
+    live->renderer.synths[0].freq_mask = LIVE_POINTS - 1;
+    live->started = 1;
+    return 0;
+}
+
+// Room in the point ring for the next pull: points from the synth's window on are
+// still needed, and a pull goes up to where the ring wraps at most
+static int live_renderer_space(const LiveRenderer *live) {
+    int in_use = live->num_points - (live->started ? live->renderer.synths[0].window : 0);
+    int free_points = LIVE_POINTS - in_use;
+    int index = live->num_points & (LIVE_POINTS - 1);
+    return LIVE_POINTS - index < free_points ? LIVE_POINTS - index : free_points;
+}
+
+// Feed interleaved input (channel 0 is tracked). Returns how many frames were
+// taken: fewer than given if the point ring is full, in which case read the
+// output before writing the rest.
+int live_renderer_write(LiveRenderer *live, const float *in, int frames) {
+    int taken = 0;
+    for (;;) {
+        int max_points = live_renderer_space(live);
+        if (max_points == 0) break;
+        
+        int pushed = taken < frames ? pitch_tracker_push(&live->tracker, in + (sf_count_t)taken * live->channels,
+                                                         live->channels, frames - taken) : 0;
+        taken += pushed;
+        live->frames_in += pushed;
+        
+        // Passes go on until every window the input completes has been pulled
+        int index = live->num_points & (LIVE_POINTS - 1);
+        int pulled = pitch_tracker_pull(&live->tracker, live->points + index, max_points);
+        live->num_points += pulled;
+        
+        if (!live->started && live->num_points >= 2 && live_renderer_start(live)) {
+            return -1;
+        }
+        if (pushed == 0 && pulled == 0) break;
+    }
+    return taken;
+}
+
+// Read back up to max_frames of output, as much as the input so far allows.
+// Once finished, that includes the release tail past the end of the input.
+// Returns the number of frames, 0 if nothing more can be rendered yet.
+int live_renderer_read(LiveRenderer *live, float *out, int max_frames) {
+    sf_count_t limit;
+    if (live->finished) {
+        limit = live->started ? live->renderer.frames : live->frames_in;
+    } else {
+        // Entering window w needs point w + 1, so stop short of the newest window
+        limit = live->num_points >= 2 ? (sf_count_t)(live->num_points - 1) * HOP_SIZE - 1 : 0;
+    }
+    
+    sf_count_t remaining = limit - live->frames_out;
+    int frames = remaining < max_frames ? (int)remaining : max_frames;
+    if (frames <= 0) return 0;
+    
+    if (!live->started) {
+        // Input too short for even one point: it comes out as silence
+        memset(out, 0, sizeof(float) * frames * live->channels);
+    } else {
+        live->renderer.synths[0].num_windows = live->num_points;
+        frames = renderer_render(&live->renderer, out, frames);
+    }
+    live->frames_out += frames;
+    return frames;
+}
+
+// The input has ended: release the note from what has been output so far and
+// hold the last window's pitch through the release. A file render starts its
+// release release_time * 1.5 seconds before the end, but live output has already
+// gone past that point, so the release runs on for release_time seconds after the
+// frames output when the input ended (or from the end of the decay, if the input
+// was shorter than that, as synth_init does). The output is that much longer than
+// the input.
+void live_renderer_finish(LiveRenderer *live) {
+    // Windows the engine was still waiting past are whole now (if the ring has room
+    // for them, which it does unless the output was never read)
+    int pulled;
+    do {
+        int index = live->num_points & (LIVE_POINTS - 1);
+        pulled = pitch_tracker_finish(&live->tracker, live->points + index, live_renderer_space(live));
+        live->num_points += pulled;
+    } while (pulled > 0);
+    
+    if (!live->started && live->num_points > 0) {
+        live_renderer_start(live);
+    }
+    if (live->started) {
+        Synth *synth = &live->renderer.synths[0];
+        const InstrumentPreset *preset = synth->preset;
+        float release_start = (float)live->frames_out / live->samplerate;
+        if (release_start < preset->attack_time + preset->decay_time) {
+            release_start = preset->attack_time + preset->decay_time + 0.1f;
+        }
+        sf_count_t end = (sf_count_t)ceilf((release_start + preset->release_time) * live->samplerate);
+        if (end < live->frames_in) end = live->frames_in;
+        
+        synth->release_start = release_start;
+        synth->num_windows = live->num_points;
+        synth->total_frames = end;
+        live->renderer.frames = end;
+    }
+    live->finished = 1;
+}
+
+void live_renderer_free(LiveRenderer *live) {
+    if (live->started) renderer_free(&live->renderer);
+    pitch_tracker_free(&live->tracker);
+    live->started = 0;
+}
+
+// Most frames the output can trail the input by: the synth glides towards the
+// point of the next window, which needs the engine's lookahead past that window's
+// start
+int live_renderer_latency(const LiveRenderer *live) {
+    return HOP_SIZE + live->tracker.lookahead;
+}
@@ -0,0 +1,280 @@
+// mix.c - in-memory buffers, resampling and the mix bus for putting tracks together
+#include "whistler.h"
+#ifdef __SSE2__
+    #include <immintrin.h>  // SSE2 for summing onto the mix bus
+#endif
+
+int audio_buffer_alloc(AudioBuffer *buffer, sf_count_t frames, int channels, int samplerate) {
+    buffer->frames = frames;
+    buffer->channels = channels;
+    buffer->samplerate = samplerate;
+    buffer->samples = (float*)calloc(frames * channels > 0 ? frames * channels : 1, sizeof(float));
+    return buffer->samples ? 0 : 1;
+}
+
+void audio_buffer_free(AudioBuffer *buffer) {
+    free(buffer->samples);
+    buffer->samples = NULL;
+    buffer->frames = 0;
+}
+
+// Read a whole audio file into memory as float
+int audio_buffer_read(const char *path, AudioBuffer *buffer) {
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    SNDFILE *file = sf_open(path, SFM_READ, &sfinfo);
+    if (!file) return 1;
+    
+    if (audio_buffer_alloc(buffer, sfinfo.frames, sfinfo.channels, sfinfo.samplerate)) {
+        sf_close(file);
+        return 1;
+    }
+    sf_count_t got = sf_readf_float(file, buffer->samples, sfinfo.frames);
+    sf_close(file);
+    if (got != sfinfo.frames) {
+        audio_buffer_free(buffer);
+        return 1;
+    }
+    return 0;
+}
+
+// Write a buffer out as a 32-bit float WAV
+int audio_buffer_write(const char *path, const AudioBuffer *buffer) {
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    sfinfo.samplerate = buffer->samplerate;
+    sfinfo.channels = buffer->channels;
+    sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    
+    SNDFILE *file = sf_open(path, SFM_WRITE, &sfinfo);
+    if (!file) return 1;
+    sf_count_t written = sf_writef_float(file, buffer->samples, buffer->frames);
+    sf_close(file);
+    return written == buffer->frames ? 0 : 1;
+}
+
+// Add `frames` frames of a track into a block of the mix bus, scaled by gain. A
+// track with fewer channels than the bus is repeated across the rest (mono goes
+// to all). The SSE2 paths multiply then add, the same two roundings as the
+// scalar loop, so the sum doesn't depend on which one ran.
+void mix_block_add(float *bus, int channels, const float *track, int track_channels, int frames, float gain) {
+    if (track_channels == channels) {
+        int samples = frames * channels;
+        int i = 0;
+#ifdef __SSE2__
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= samples; i += 4) {
+            __m128 sum = _mm_add_ps(_mm_loadu_ps(bus + i), _mm_mul_ps(_mm_loadu_ps(track + i), g));
+            _mm_storeu_ps(bus + i, sum);
+        }
+#endif
+        for (; i < samples; i++) {
+            bus[i] += track[i] * gain;
+        }
+        return;
+    }
+    
+    int i = 0;
+#ifdef __SSE2__
+    if (track_channels == 1 && channels == 2) {
+        // Mono onto a stereo bus: each scaled sample goes to both sides
+        __m128 g = _mm_set1_ps(gain);
+        for (; i + 4 <= frames; i += 4) {
+            __m128 scaled = _mm_mul_ps(_mm_loadu_ps(track + i), g);
+            float *dst = bus + i * 2;
+            _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_unpacklo_ps(scaled, scaled)));
+            _mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4), _mm_unpackhi_ps(scaled, scaled)));
+        }
+    }
+#endif
+    for (; i < frames; i++) {
+        for (int ch = 0; ch < channels; ch++) {
+            bus[i * channels + ch] += track[i * track_channels + ch % track_channels] * gain;
+        }
+    }
+}
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind (for the Kaiser window)
+double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+int resampler_init(Resampler *resampler, int in_rate, int out_rate, int channels) {
+    memset(resampler, 0, sizeof(Resampler));
+    int divisor = gcd(in_rate, out_rate);
+    resampler->channels = channels;
+    resampler->up = out_rate / divisor;
+    resampler->down = in_rate / divisor;
+    if (resampler->up == resampler->down) return 0;
+    
+    // Downsampling narrows the band to the output's Nyquist, and the kernel widens
+    // to keep the same transition sharpness
+    double band = resampler->up < resampler->down ? (double)resampler->up / resampler->down : 1.0;
+    double cutoff = RESAMPLE_ROLLOFF * band;
+    resampler->half = (int)ceil(RESAMPLE_HALF_TAPS / band);
+    if (resampler->half > 64 * RESAMPLE_HALF_TAPS) resampler->half = 64 * RESAMPLE_HALF_TAPS;
+    resampler->taps = 2 * resampler->half;
+    resampler->phases = resampler->up <= RESAMPLE_MAX_PHASES ? resampler->up : RESAMPLE_MAX_PHASES;
+    
+    int half = resampler->half;
+    int taps = resampler->taps;
+    resampler->coeffs = (float*)malloc(sizeof(float) * resampler->phases * taps);
+    resampler->capacity = taps + STREAM_BLOCK;
+    resampler->history = (float*)calloc((size_t)resampler->capacity * channels, sizeof(float));
+    profile_alloc(PROFILE_RESAMPLE, sizeof(float) * resampler->phases * taps +
+                  sizeof(float) * (size_t)resampler->capacity * channels);
+    if (!resampler->coeffs || !resampler->history) {
+        resampler_free(resampler);
+        return 1;
+    }
+    
+    // Phase p puts the output p/phases of the way from input frame i to i + 1; its
+    // taps weight frames i - half + 1 .. i + half. Each set is normalised to unity
+    // gain at DC so a constant stays constant.
+    double window_scale = 1.0 / bessel_i0(RESAMPLE_KAISER_BETA);
+    for (int p = 0; p < resampler->phases; p++) {
+        double frac = (double)p / resampler->phases;
+        float *set = resampler->coeffs + (sf_count_t)p * taps;
+        double sum = 0.0;
+        for (int t = 0; t < taps; t++) {
+            double distance = t - half + 1 - frac;
+            double x = distance / half;
+            double window = x * x < 1.0 ? bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1.0 - x * x)) * window_scale : 0.0;
+            double sinc = distance == 0.0 ? cutoff : sin(M_PI * cutoff * distance) / (M_PI * distance);
+            set[t] = (float)(sinc * window);
+            sum += set[t];
+        }
+        for (int t = 0; t < taps; t++) {
+            set[t] = (float)(set[t] / sum);
+        }
+    }
+    
+    // The first outputs reach back before the input: that's silence
+    resampler->filled = half;
+    resampler->base = -half;
+    return 0;
+}
+
+void resampler_free(Resampler *resampler) {
+    free(resampler->coeffs);
+    free(resampler->history);
+    resampler->coeffs = NULL;
+    resampler->history = NULL;
+}
+
+// Output frames for `in_frames` of input in total
+sf_count_t resampler_output_frames(const Resampler *resampler, sf_count_t in_frames) {
+    return in_frames * resampler->up / resampler->down;
+}
+
+// Most frames resampler_process() can give for `frames` of input
+int resampler_max_output(const Resampler *resampler, int frames) {
+    if (resampler->up == resampler->down) return frames;
+    return (int)(((sf_count_t)frames * resampler->up + resampler->down - 1) / resampler->down) + 1;
+}
+
+// Drop the history no output from `next` on reaches back to
+static void resampler_compact(Resampler *resampler) {
+    sf_count_t first = resampler->next * resampler->down / resampler->up - resampler->half + 1;
+    sf_count_t drop = first - resampler->base;
+    if (drop <= 0) return;
+    if (drop > resampler->filled) drop = resampler->filled;
+    
+    int channels = resampler->channels;
+    memmove(resampler->history, resampler->history + drop * channels,
+            sizeof(float) * (resampler->filled - drop) * channels);
+    resampler->filled -= (int)drop;
+    resampler->base += drop;
+}
+
+// Produce outputs (before frame `limit`, up to max_frames) for as far as the history reaches
+static int resampler_run(Resampler *resampler, float *out, sf_count_t limit, int max_frames) {
+    int channels = resampler->channels;
+    int taps = resampler->taps;
+    int produced = 0;
+    while (produced < max_frames && resampler->next < limit) {
+        sf_count_t position = resampler->next * resampler->down;
+        sf_count_t index = position / resampler->up;
+        int phase = (int)(position % resampler->up);
+        if (resampler->phases != resampler->up) {
+            phase = (int)(((sf_count_t)phase * resampler->phases + resampler->up / 2) / resampler->up);
+            if (phase == resampler->phases) {
+                phase = 0;
+                index++;
+            }
+        }
+        if (index + resampler->half >= resampler->base + resampler->filled) break;  // Needs more input
+        
+        const float *set = resampler->coeffs + (sf_count_t)phase * taps;
+        const float *x = resampler->history + (index - resampler->half + 1 - resampler->base) * channels;
+        float *dst = out + (sf_count_t)produced * channels;
+        for (int ch = 0; ch < channels; ch++) {
+            float sum = 0.0f;
+            for (int t = 0; t < taps; t++) {
+                sum += x[t * channels + ch] * set[t];
+            }
+            dst[ch] = sum;
+        }
+        produced++;
+        resampler->next++;
+    }
+    return produced;
+}
+
+// Resample the next `frames` frames of input. out must hold resampler_max_output()
+// frames; returns how many were written (the last few wait on later input).
+int resampler_process(Resampler *resampler, const float *in, int frames, float *out) {
+    int channels = resampler->channels;
+    if (resampler->up == resampler->down) {
+        memcpy(out, in, sizeof(float) * frames * channels);
+        resampler->frames_in += frames;
+        return frames;
+    }
+    
+    int produced = 0;
+    int taken = 0;
+    while (taken < frames) {
+        resampler_compact(resampler);
+        int take = resampler->capacity - resampler->filled;
+        if (take > frames - taken) take = frames - taken;
+        memcpy(resampler->history + (sf_count_t)resampler->filled * channels,
+               in + (sf_count_t)taken * channels, sizeof(float) * take * channels);
+        resampler->filled += take;
+        resampler->frames_in += take;
+        taken += take;
+        produced += resampler_run(resampler, out + (sf_count_t)produced * channels, INT64_MAX, INT32_MAX);
+    }
+    return produced;
+}
+
+// The input has ended: write up to max_frames of the outputs still owed (the input
+// is taken to be silent past its end). Returns 0 once there are none left.
+int resampler_flush(Resampler *resampler, float *out, int max_frames) {
+    if (resampler->up == resampler->down) return 0;
+    if (resampler->base + resampler->filled <= resampler->frames_in) {
+        resampler_compact(resampler);
+        int channels = resampler->channels;
+        int silence = resampler->half + 1;
+        memset(resampler->history + (sf_count_t)resampler->filled * channels, 0,
+               sizeof(float) * silence * channels);
+        resampler->filled += silence;
+    }
+    sf_count_t total = resampler_output_frames(resampler, resampler->frames_in);
+    return resampler_run(resampler, out, total, max_frames);
+}
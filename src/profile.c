@@ -0,0 +1,259 @@
+// profile.c - per-stage, per-track timers and allocation counts for --profile, written
+// out as a JSON report and optionally a Chrome trace (chrome://tracing, Perfetto)
+#include "whistler.h"
+#include <time.h>
+#include <sys/resource.h>
+
+#define PROFILE_TRACE_EVENTS (1 << 20)  // Spans kept for the trace; later ones are counted, not kept
+
+const char *profile_stage_names[PROFILE_STAGES] = {
+    "setup", "cache", "decode", "analysis", "synth", "chorus", "reverb", "volume",
+    "resample", "echo", "mix", "limiter", "encode"
+};
+
+// Per (track, stage) totals, bumped from any thread
+typedef struct {
+    int64_t ns;
+    int64_t calls;
+    int64_t allocations;
+    int64_t bytes;
+} ProfileCounter;
+
+// One span for the trace
+typedef struct {
+    int64_t start;          // ns since profile_init
+    int64_t duration;
+    int stage;
+    int track;
+    int thread;
+} ProfileEvent;
+
+int profile_enabled = 0;
+
+static struct {
+    const char *tool;
+    int num_tracks;
+    char (*track_names)[256];
+    ProfileCounter (*counters)[PROFILE_STAGES];  // [num_tracks + 1], slot 0 for untracked work
+    int64_t origin;
+    ProfileEvent *events;       // NULL unless tracing
+    int64_t num_events;         // Spans offered to the trace, kept or not
+    int num_threads;
+} profile;
+
+static __thread int profile_thread_track = -1;
+static __thread int profile_thread_id = 0;     // 0 until the thread records a span
+
+int64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Turn profiling on for a run of `num_tracks` tracks (outputs, for whistler). With
+// `trace`, every span is kept for a trace file as well as counted.
+int profile_init(const char *tool, int num_tracks, int trace) {
+    memset(&profile, 0, sizeof(profile));
+    profile.tool = tool;
+    profile.num_tracks = num_tracks;
+    profile.track_names = calloc(num_tracks > 0 ? num_tracks : 1, sizeof(*profile.track_names));
+    profile.counters = calloc(num_tracks + 1, sizeof(*profile.counters));
+    profile.events = trace ? malloc(sizeof(ProfileEvent) * PROFILE_TRACE_EVENTS) : NULL;
+    if (!profile.track_names || !profile.counters || (trace && !profile.events)) {
+        profile_free();
+        return 1;
+    }
+    profile.origin = profile_now();
+    profile_enabled = 1;
+    return 0;
+}
+
+void profile_free(void) {
+    profile_enabled = 0;
+    free(profile.track_names);
+    free(profile.counters);
+    free(profile.events);
+    memset(&profile, 0, sizeof(profile));
+}
+
+void profile_set_track_name(int track, const char *name) {
+    if (!profile_enabled || track < 0 || track >= profile.num_tracks) return;
+    snprintf(profile.track_names[track], sizeof(profile.track_names[track]), "%s", name);
+}
+
+// Charge what this thread does from now on to `track` (-1: no track in particular)
+void profile_set_track(int track) {
+    profile_thread_track = track;
+}
+
+int profile_get_track(void) {
+    return profile_thread_track;
+}
+
+static ProfileCounter *profile_counter(int stage) {
+    int track = profile_thread_track;
+    int slot = track >= 0 && track < profile.num_tracks ? track + 1 : 0;
+    return &profile.counters[slot][stage];
+}
+
+// Start timing a span: pass what this returns to profile_end (0 when profiling is off)
+int64_t profile_begin(void) {
+    return profile_enabled ? profile_now() : 0;
+}
+
+// Count the span from `start` to now against `stage`, and keep it for the trace
+void profile_end(int stage, int64_t start) {
+    if (!start) return;
+    int64_t end = profile_now();
+    profile_add(stage, end - start, 1);
+    if (!profile.events) return;
+    
+    if (!profile_thread_id) {
+        profile_thread_id = __atomic_add_fetch(&profile.num_threads, 1, __ATOMIC_RELAXED);
+    }
+    int64_t index = __atomic_fetch_add(&profile.num_events, 1, __ATOMIC_RELAXED);
+    if (index < PROFILE_TRACE_EVENTS) {
+        ProfileEvent *event = &profile.events[index];
+        event->start = start - profile.origin;
+        event->duration = end - start;
+        event->stage = stage;
+        event->track = profile_thread_track;
+        event->thread = profile_thread_id;
+    }
+}
+
+// Count time measured elsewhere (work too fine-grained to trace span by span).
+// Negative `ns` takes back time a span counted that belongs to another stage.
+void profile_add(int stage, int64_t ns, int64_t calls) {
+    if (!profile_enabled) return;
+    ProfileCounter *counter = profile_counter(stage);
+    __atomic_fetch_add(&counter->ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->calls, calls, __ATOMIC_RELAXED);
+}
+
+// Count an allocation of `bytes` made for `stage`
+void profile_alloc(int stage, size_t bytes) {
+    if (!profile_enabled) return;
+    ProfileCounter *counter = profile_counter(stage);
+    __atomic_fetch_add(&counter->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counter->bytes, (int64_t)bytes, __ATOMIC_RELAXED);
+}
+
+static void write_json_string(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const unsigned char *p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void write_counter(FILE *file, const char *indent, int stage, const ProfileCounter *counter,
+                          int last) {
+    fprintf(file, "%s\"%s\": {\"seconds\": %.6f, \"calls\": %lld, \"allocations\": %lld, \"bytes\": %lld}%s\n",
+            indent, profile_stage_names[stage], counter->ns * 1e-9, (long long)counter->calls,
+            (long long)counter->allocations, (long long)counter->bytes, last ? "" : ",");
+}
+
+static int counter_used(const ProfileCounter *counter) {
+    return counter->calls != 0 || counter->allocations != 0;
+}
+
+static const char *track_label(int track) {
+    return track < 0 ? "(shared)" : profile.track_names[track];
+}
+
+// Peak resident memory of the process so far, in bytes
+static long long peak_rss_bytes(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss;          // Already bytes
+#else
+    return (long long)usage.ru_maxrss * 1024;   // Kilobytes
+#endif
+}
+
+static int write_report(const char *path, double wall_seconds) {
+    FILE *file = fopen(path, "w");
+    if (!file) return 1;
+    
+    // Totals over every track; every stage is listed so the keys never change
+    ProfileCounter totals[PROFILE_STAGES];
+    memset(totals, 0, sizeof(totals));
+    for (int slot = 0; slot <= profile.num_tracks; slot++) {
+        for (int s = 0; s < PROFILE_STAGES; s++) {
+            totals[s].ns += profile.counters[slot][s].ns;
+            totals[s].calls += profile.counters[slot][s].calls;
+            totals[s].allocations += profile.counters[slot][s].allocations;
+            totals[s].bytes += profile.counters[slot][s].bytes;
+        }
+    }
+    
+    int64_t kept = profile.num_events < PROFILE_TRACE_EVENTS ? profile.num_events : PROFILE_TRACE_EVENTS;
+    fprintf(file, "{\n  \"tool\": \"%s\",\n  \"engine_version\": %d,\n", profile.tool, WHISTLER_ENGINE_VERSION);
+    fprintf(file, "  \"wall_seconds\": %.6f,\n  \"peak_rss_bytes\": %lld,\n", wall_seconds, peak_rss_bytes());
+    fprintf(file, "  \"trace_events\": %lld,\n  \"trace_events_dropped\": %lld,\n",
+            (long long)kept, (long long)(profile.num_events - kept));
+    fprintf(file, "  \"stages\": {\n");
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+        write_counter(file, "    ", s, &totals[s], s == PROFILE_STAGES - 1);
+    }
+    
+    // Then each track's own stages; slot 0 is work no one track owns (the shared
+    // analysis for whistler's outputs, the mix bus for chorus)
+    fprintf(file, "  },\n  \"tracks\": [\n");
+    for (int slot = 0; slot <= profile.num_tracks; slot++) {
+        const ProfileCounter *counters = profile.counters[slot];
+        int last_stage = -1;
+        for (int s = 0; s < PROFILE_STAGES; s++) {
+            if (counter_used(&counters[s])) last_stage = s;
+        }
+        fprintf(file, "    {\"index\": %d, \"name\": ", slot - 1);
+        write_json_string(file, track_label(slot - 1));
+        fprintf(file, ", \"stages\": {\n");
+        for (int s = 0; s <= last_stage; s++) {
+            if (counter_used(&counters[s])) write_counter(file, "      ", s, &counters[s], s == last_stage);
+        }
+        fprintf(file, "    }}%s\n", slot == profile.num_tracks ? "" : ",");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) != 0;
+}
+
+static int write_trace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return 1;
+    
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"%s\"}}",
+            profile.tool);
+    int64_t kept = profile.num_events < PROFILE_TRACE_EVENTS ? profile.num_events : PROFILE_TRACE_EVENTS;
+    for (int64_t i = 0; i < kept; i++) {
+        const ProfileEvent *event = &profile.events[i];
+        fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": 1, \"tid\": %d, \"args\": {\"track\": ",
+                profile_stage_names[event->stage], event->track < 0 ? "shared" : "track",
+                event->start * 1e-3, event->duration * 1e-3, event->thread);
+        write_json_string(file, track_label(event->track));
+        fprintf(file, "}}");
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) != 0;
+}
+
+// Write the report (and the trace, if one was kept and `trace_path` isn't NULL)
+int profile_write(const char *report_path, const char *trace_path) {
+    if (!profile_enabled) return 1;
+    double wall_seconds = (profile_now() - profile.origin) * 1e-9;
+    int failed = report_path && write_report(report_path, wall_seconds);
+    if (trace_path && profile.events) {
+        failed |= write_trace(trace_path);
+    }
+    return failed;
+}
@@ -0,0 +1,438 @@
+// render.c - analyse an input file and render it with an instrument, either a block
+// at a time (Renderer) or as a whole in memory (render_file)
+#include "whistler.h"
+#include <sys/mman.h>
+
+void render_options_init(RenderOptions *options) {
+    options->instrument = INSTR_PAD;
+    options->transpose = 0.0f;
+    options->volume = 1.0f;
+    options->threads = default_thread_count();
+    options->fft_planner = FFTW_ESTIMATE;
+    options->wisdom_file = NULL;
+    options->kernel = osc_bank_select("auto");
+    options->control_block = CONTROL_BLOCK;
+    options->pitch_cache = 1;
+    options->pitch_engine = pitch_engine_find(NULL);
+    options->adaptive_hop = 0;
+    options->per_channel = 0;
+}
+
+// Close whichever of the two input readers is open
+static void close_input(SNDFILE *infile, WavMap *map) {
+    if (infile) {
+        sf_close(infile);
+    } else {
+        wav_map_close(map);
+    }
+}
+
+// Work out the input's pitch track, or reuse the one in its sidecar if that's
+// still current (then the input is never decoded, and only hashed if its size,
+// modification time or ends have changed)
+int pitch_track_analyze(const char *input_file, const RenderOptions *options, PitchTrack *track) {
+    memset(track, 0, sizeof(PitchTrack));
+    
+    char sidecar[512];
+    int64_t start = profile_begin();
+    uint32_t flags = (options->adaptive_hop ? PITCH_TRACK_ADAPTIVE : 0) |
+                     (options->per_channel ? PITCH_TRACK_PER_CHANNEL : 0);
+    if (options->pitch_cache) {
+        pitch_track_sidecar_path(input_file, sidecar, sizeof(sidecar));
+        if (pitch_track_load(sidecar, input_file, options->pitch_engine->id, flags, track) == 0) {
+            profile_end(PROFILE_CACHE, start);
+            printf("Processing file: %s\n", input_file);
+            printf("Sample rate: %d Hz, Channels: %d, Frames: %lld\n",
+                   track->samplerate, track->channels, (long long)track->frames);
+            printf("Loaded pitch track from %s\n", sidecar);
+            return 0;
+        }
+    }
+    profile_end(PROFILE_CACHE, start);
+    
+    // Uncompressed WAV/RF64 is mapped and only the channels analysed converted, on
+    // demand; anything else is decoded by libsndfile
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    SNDFILE *infile = NULL;
+    WavMap map;
+    start = profile_begin();
+    int mapped = wav_map_open(input_file, &map) == 0;
+    if (mapped) {
+        sfinfo.frames = map.frames;
+        sfinfo.samplerate = map.samplerate;
+        sfinfo.channels = map.channels;
+    } else {
+        infile = sf_open(input_file, SFM_READ, &sfinfo);
+        if (!infile) {
+            printf("Error opening input file %s: %s\n", input_file, sf_strerror(NULL));
+            return 1;
+        }
+    }
+    
+    printf("Processing file: %s\n", input_file);
+    printf("Sample rate: %d Hz, Channels: %d, Frames: %lld\n",
+           sfinfo.samplerate, sfinfo.channels, (long long)sfinfo.frames);
+    
+    // Analyze audio
+    int num_windows = (int)((sfinfo.frames - WINDOW_SIZE) / HOP_SIZE + 1);
+    if (sfinfo.frames < WINDOW_SIZE) {
+        printf("Error: Input is shorter than one analysis window (%d frames)\n", WINDOW_SIZE);
+        close_input(infile, &map);
+        return 1;
+    }
+    
+    // The pitch track is the only thing sized by the input length: 8 bytes per hop
+    // (per channel, with a track for each)
+    int voices = options->per_channel ? sfinfo.channels : 1;
+    size_t track_bytes = (size_t)num_windows * voices * sizeof(FrequencyPoint);
+    FrequencyPoint *freq_data = malloc(track_bytes);
+    profile_alloc(PROFILE_ANALYSIS, track_bytes);
+    if (!freq_data) {
+        printf("Failed to allocate memory\n");
+        close_input(infile, &map);
+        return 1;
+    }
+    
+    // No point in more workers than there are batches (or adaptive regions) to hand out
+    int unit = options->adaptive_hop ? ADAPTIVE_REGION : ANALYSIS_BATCH;
+    int num_threads = options->threads;
+    int max_threads = (num_windows + unit - 1) / unit;
+    if (num_threads > max_threads) num_threads = max_threads;
+    
+    // Plan the analysis FFTs once for the whole run, reusing any saved wisdom.
+    // Each worker gets its own plan and buffers; planning itself isn't thread-safe,
+    // so it all happens here up front (later plans hit the wisdom of the first).
+    const char *wisdom_file = options->wisdom_file;
+    pthread_mutex_lock(&fftw_planner_lock);
+    int loaded = wisdom_file && fftwf_import_wisdom_from_filename(wisdom_file);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    if (loaded) {
+        printf("Loaded FFTW wisdom from %s\n", wisdom_file);
+    }
+    // With adaptive hops each worker also gets a state sized for the windows between
+    // two coarse ones
+    const PitchEngine *engine = options->pitch_engine;
+    void *states[num_threads];
+    void *fine_states[num_threads];
+    for (int t = 0; t < num_threads; t++) {
+        states[t] = engine->create(sfinfo.samplerate, ANALYSIS_BATCH, options->fft_planner);
+        fine_states[t] = options->adaptive_hop && states[t]
+                       ? engine->create(sfinfo.samplerate, ADAPTIVE_HOPS - 1, options->fft_planner) : NULL;
+        if (!states[t] || (options->adaptive_hop && !fine_states[t])) {
+            printf("Failed to create FFT plan\n");
+            for (int i = 0; i <= t; i++) {
+                if (states[i]) engine->destroy(states[i]);
+                if (fine_states[i]) engine->destroy(fine_states[i]);
+            }
+            free(freq_data);
+            close_input(infile, &map);
+            return 1;
+        }
+    }
+    pthread_mutex_lock(&fftw_planner_lock);
+    int saved = !wisdom_file || fftwf_export_wisdom_to_filename(wisdom_file);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    if (!saved) {
+        printf("Warning: Could not save FFTW wisdom to %s\n", wisdom_file);
+    }
+    
+    profile_end(PROFILE_SETUP, start);
+    
+    if (voices > 1) {
+        printf("Analyzing %d windows of each of %d channels on %d thread%s (%s pitch engine%s)\n", num_windows,
+               voices, num_threads, num_threads == 1 ? "" : "s", engine->name,
+               options->adaptive_hop ? ", adaptive hop" : "");
+    } else {
+        printf("Analyzing %d windows on %d thread%s (%s pitch engine%s)\n", num_windows, num_threads,
+               num_threads == 1 ? "" : "s", engine->name, options->adaptive_hop ? ", adaptive hop" : "");
+    }
+    void **fine = options->adaptive_hop ? fine_states : NULL;
+    int analysed = 0;
+    int failed = mapped ? analyze_mapped(&map, engine, states, fine, num_threads, num_windows, voices, freq_data,
+                                         &analysed)
+                        : analyze_file(infile, &sfinfo, engine, states, fine, num_threads, num_windows, voices,
+                                       freq_data, &analysed);
+    close_input(infile, &map);
+    for (int t = 0; t < num_threads; t++) {
+        engine->destroy(states[t]);
+        if (fine_states[t]) engine->destroy(fine_states[t]);
+    }
+    if (failed) {
+        free(freq_data);
+        return 1;
+    }
+    if (options->adaptive_hop) {
+        printf("Analyzed %d of %d windows (%.0f%%), interpolated the rest\n", analysed, num_windows * voices,
+               100.0 * analysed / ((double)num_windows * voices));
+    }
+    start = profile_begin();
+    for (int v = 0; v < voices; v++) {
+        resolve_pitch_track(freq_data + (sf_count_t)v * num_windows, num_windows);
+    }
+    profile_end(PROFILE_ANALYSIS, start);
+    
+    track->points = freq_data;
+    track->num_windows = num_windows;
+    track->voices = voices;
+    track->frames = sfinfo.frames;
+    track->samplerate = sfinfo.samplerate;
+    track->channels = sfinfo.channels;
+    
+    // The sidecar records the input's hash as well as its key, so a touched but
+    // unchanged input still matches it
+    if (options->pitch_cache) {
+        start = profile_begin();
+        uint64_t key, source_hash;
+        if (source_key(input_file, &key) == 0 && hash_file(input_file, &source_hash) == 0 &&
+            pitch_track_save(sidecar, key, source_hash, options->pitch_engine->id, flags, track) == 0) {
+            printf("Saved pitch track to %s\n", sidecar);
+        } else {
+            printf("Warning: Could not save pitch track to %s\n", sidecar);
+        }
+        profile_end(PROFILE_CACHE, start);
+    }
+    return 0;
+}
+
+void pitch_track_free(PitchTrack *track) {
+    if (track->mapping) {
+        munmap(track->mapping, track->mapping_size);
+    } else {
+        free(track->points);
+    }
+    track->points = NULL;
+    track->mapping = NULL;
+}
+
+// Render the voices that fall to pool thread `thread` (0 is the caller) for one block
+static void render_voices(Renderer *renderer, int thread, int frames) {
+    for (int v = thread; v < renderer->voices; v += renderer->pool.num_threads + 1) {
+        synth_render(&renderer->synths[v], renderer->planar + (sf_count_t)v * STREAM_BLOCK, frames);
+    }
+}
+
+// A pool helper: take the next thread number, then wait for each block, render
+// its voices and report back
+static void *voice_helper(void *arg) {
+    Renderer *renderer = (Renderer*)arg;
+    VoicePool *pool = &renderer->pool;
+    profile_set_track(pool->profile_track);
+    
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    int thread = ++pool->joined;
+    for (;;) {
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) break;
+        seen = pool->generation;
+        int frames = pool->frames;
+        pthread_mutex_unlock(&pool->lock);
+        
+        render_voices(renderer, thread, frames);
+        
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start up to `helpers` threads to share the voices with the caller. Fewer (or
+// none) is fine: the caller renders whatever isn't handed out.
+static void voice_pool_start(Renderer *renderer, int helpers) {
+    VoicePool *pool = &renderer->pool;
+    pool->profile_track = profile_get_track();
+    if (helpers <= 0) return;
+    
+    pool->threads = (pthread_t*)malloc(helpers * sizeof(pthread_t));
+    if (!pool->threads) return;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    
+    // The helper count is fixed before any starts, since it sets which voices each renders
+    pool->num_threads = helpers;
+    int started = 0;
+    while (started < helpers && pthread_create(&pool->threads[started], NULL, voice_helper, renderer) == 0) {
+        started++;
+    }
+    if (started < helpers) {
+        // Couldn't spawn them all - stop the ones that did and render on this thread
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = 1;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        for (int t = 0; t < started; t++) {
+            pthread_join(pool->threads[t], NULL);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->start);
+        pthread_cond_destroy(&pool->done);
+        free(pool->threads);
+        pool->threads = NULL;
+        pool->num_threads = 0;
+        pool->quit = 0;
+    }
+}
+
+static void voice_pool_stop(VoicePool *pool) {
+    if (!pool->threads) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 0; t < pool->num_threads; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->num_threads = 0;
+}
+
+// Set up to render a pitch track. The track must outlive the renderer. A track per
+// channel gets a voice per channel, rendered side by side on up to options->threads
+// threads.
+int renderer_init(Renderer *renderer, const PitchTrack *track, const RenderOptions *options) {
+    int64_t start = profile_begin();
+    memset(renderer, 0, sizeof(Renderer));
+    renderer->volume = options->volume;
+    renderer->channels = track->channels;
+    renderer->frames = track->frames;
+    renderer->voices = track->voices > 1 ? track->voices : 1;
+    
+    // Reverb thickens the sound, mixed in by the preset's amount
+    renderer->reverb = reverb_create(presets[options->instrument].reverb_mix, REVERB_DECAY);
+    renderer->synths = (Synth*)calloc(renderer->voices, sizeof(Synth));
+    renderer->planar = malloc((size_t)renderer->voices * STREAM_BLOCK * sizeof(float));
+    profile_alloc(PROFILE_SYNTH, (size_t)renderer->voices * STREAM_BLOCK * sizeof(float));
+    int failed = !renderer->reverb || !renderer->synths || !renderer->planar;
+    for (int v = 0; v < renderer->voices && !failed; v++) {
+        failed |= synth_init(&renderer->synths[v], options->instrument,
+                             track->points + (sf_count_t)v * track->num_windows, track->num_windows,
+                             track->frames, track->samplerate, semitones_to_multiplier(options->transpose),
+                             options->kernel, options->control_block);
+    }
+    if (failed) {
+        printf("Failed to allocate memory\n");
+        renderer_free(renderer);
+        return 1;
+    }
+    int threads = options->threads < renderer->voices ? options->threads : renderer->voices;
+    voice_pool_start(renderer, threads - 1);
+    profile_end(PROFILE_SETUP, start);
+    return 0;
+}
+
+// Synthesize one block of every voice into its plane, the helpers taking their share
+static void render_block(Renderer *renderer, int frames) {
+    VoicePool *pool = &renderer->pool;
+    if (!pool->threads) {
+        render_voices(renderer, 0, frames);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->frames = frames;
+    pool->pending = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    
+    render_voices(renderer, 0, frames);
+    
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Render up to `max_frames` more interleaved frames into out: synthesize (with
+// chorus), reverb, volume. Returns the number of frames rendered, 0 at the end.
+int renderer_render(Renderer *renderer, float *out, int max_frames) {
+    Synth *synth = &renderer->synths[0];  // Every voice is at the same position
+    int channels = renderer->channels;
+    int voices = renderer->voices;
+    int done = 0;
+    
+    while (done < max_frames && synth->position < renderer->frames) {
+        sf_count_t remaining = renderer->frames - synth->position;
+        int frames = remaining < STREAM_BLOCK ? (int)remaining : STREAM_BLOCK;
+        if (frames > max_frames - done) frames = max_frames - done;
+        float *block = out + (sf_count_t)done * channels;
+        
+        render_block(renderer, frames);
+        
+        // Each channel's own voice, or the one voice on every channel
+        int64_t start = profile_begin();
+        for (int ch = 0; ch < channels; ch++) {
+            const float *plane = renderer->planar + (voices > 1 ? (sf_count_t)ch * STREAM_BLOCK : 0);
+            for (int i = 0; i < frames; i++) {
+                block[i * channels + ch] = plane[i];
+            }
+        }
+        profile_end(PROFILE_VOLUME, start);
+        
+        start = profile_begin();
+        apply_reverb(renderer->reverb, block, frames, channels);
+        profile_end(PROFILE_REVERB, start);
+        
+        // After applying reverb, apply the volume multiplier
+        start = profile_begin();
+        for (int i = 0; i < frames * channels; i++) {
+            block[i] *= renderer->volume;
+        }
+        profile_end(PROFILE_VOLUME, start);
+        done += frames;
+    }
+    return done;
+}
+
+void renderer_free(Renderer *renderer) {
+    voice_pool_stop(&renderer->pool);
+    for (int v = 0; renderer->synths && v < renderer->voices; v++) {
+        synth_free(&renderer->synths[v]);
+    }
+    reverb_destroy(renderer->reverb);
+    free(renderer->synths);
+    free(renderer->planar);
+    renderer->reverb = NULL;
+    renderer->synths = NULL;
+    renderer->planar = NULL;
+}
+
+// Analyse and render a whole file into memory
+int render_file(const char *input_file, const RenderOptions *options, AudioBuffer *out) {
+    PitchTrack track;
+    if (pitch_track_analyze(input_file, options, &track)) {
+        return 1;
+    }
+    
+    Renderer renderer;
+    if (renderer_init(&renderer, &track, options)) {
+        pitch_track_free(&track);
+        return 1;
+    }
+    if (audio_buffer_alloc(out, track.frames, track.channels, track.samplerate)) {
+        printf("Failed to allocate memory\n");
+        renderer_free(&renderer);
+        pitch_track_free(&track);
+        return 1;
+    }
+    
+    sf_count_t position = 0;
+    while (position < out->frames) {
+        sf_count_t remaining = out->frames - position;
+        int frames = remaining < STREAM_BLOCK ? (int)remaining : STREAM_BLOCK;
+        position += renderer_render(&renderer, out->samples + position * out->channels, frames);
+    }
+    
+    renderer_free(&renderer);
+    pitch_track_free(&track);
+    return 0;
+}
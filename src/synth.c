@@ -0,0 +1,1095 @@
+// synth.c - instrument waveforms, wavetables, the oscillator bank and the synth voice
+#include "whistler.h"
+#if defined(__x86_64__)
+    #include <immintrin.h>  // SSE2 is always there; AVX2 kernels are picked at runtime
+    #define HAVE_X86_SIMD 1
+#endif
+
+// Simple sine wave generator with soft edges
+float soft_sine(float x) {
+    // Blend between sine and a softer waveform
+    float pure_sine = sinf(x);
+    // Add a small amount of the third harmonic with inverted phase
+    // This reduces the harsh transitions
+    return pure_sine * 0.98f - 0.02f * sinf(3 * x);
+}
+
+float triangle_wave(float x) {
+    const float pi = (float)M_PI;  // Convert M_PI to float explicitly
+    return 2.0f * (fabsf(fmodf(x, 2.0f * pi) - pi) - pi / 2.0f);
+}
+
+float square_wave(float x) {
+    return sinf(x) >= 0.0f ? 1.0f : -1.0f;
+}
+
+float sawtooth_wave(float x) {
+    return 2.0f * (fmodf(x / (2.0f * M_PI), 1.0f) - 0.5f);
+}
+
+float noise(void) {
+    return 2.0f * ((float)rand() / RAND_MAX) - 1.0f;
+}
+
+// Blended waveform for rich pad sound
+float pad_wave(float x, float blend) {
+    float sine = sinf(x);
+    float sine2 = sinf(x * 2.001f) * 0.3f;  // Second partial with slight detuning
+    float sine3 = sinf(x * 0.5f) * 0.4f;    // Sub-oscillator for fullness
+    float tri = triangle_wave(x) * 0.7f;    // Softer triangle component
+    float saw = sawtooth_wave(x) * 0.5f;    // Gentler sawtooth component
+    
+    // Combine sine waves for a complex, rich tone
+    float full_sine = sine + sine2 + sine3;
+    full_sine *= 0.6f;  // Scale to avoid clipping
+    
+    // Create complex waveforms with softer edges
+    float complex_tone = tri + saw;
+    complex_tone *= 0.6f;  // Scale to avoid clipping
+    
+    // Blend sine-heavy tone with complex tone
+    return full_sine * (1.0f - blend) + complex_tone * blend;
+}
+
+// Bell/FM waveform
+float bell_wave(float x, float harmonics) {
+    float carrier = sinf(x);
+    float modulator = sinf(x * 2.0f) * 5.0f * harmonics;
+    return sinf(x + modulator);
+}
+
+// Add harmonics for organ/brass sounds
+float harmonic_wave(float x, float harmonics) {
+    float result = sinf(x); // Fundamental
+    float amp = 1.0f;
+    
+    // Add odd harmonics (organ-like)
+    for (int h = 3; h <= 9; h += 2) {
+        amp *= 0.5f;
+        result += amp * harmonics * sinf(x * h);
+    }
+    
+    return result / (1.0f + harmonics);
+}
+
+// Pluck/string waveform (combines harmonics)
+float pluck_wave(float x, float brightness) {
+    float result = 0.0f;
+    float amp = 1.0f;
+    
+    // Add harmonics with decay based on brightness
+    for (int h = 1; h <= 12; h++) {
+        float harmonic_amp = amp * expf(-h * (1.0f - brightness));
+        result += harmonic_amp * sinf(x * h);
+        amp *= 0.7f;
+    }
+    
+    return result * 0.3f; // Scale to avoid clipping
+}
+
+// Acid/303-style waveform with resonant filter emulation
+float acid_wave(float x, float cutoff, float resonance) {
+    // Basic sawtooth as the source
+    float saw = sawtooth_wave(x);
+    
+    // Add slight phase-shifted duplicates to simulate resonance
+    float resonant = saw;
+    resonant += 0.4f * resonance * sawtooth_wave(x + 0.05f);
+    resonant += 0.2f * resonance * sawtooth_wave(x - 0.03f);
+    
+    // Apply a soft clip to emulate filter distortion
+    if (resonant > 0.8f) resonant = 0.8f + (resonant - 0.8f) * 0.5f;
+    if (resonant < -0.8f) resonant = -0.8f + (resonant + 0.8f) * 0.5f;
+    
+    return resonant * cutoff; 
+}
+
+// General purpose instrument waveform selector
+float instrument_wave(float x, int instrument, float wave_blend, float brightness, float harmonics) {
+    float result = 0.0f;
+    
+    switch (instrument) {
+        case INSTR_PAD:
+            return pad_wave(x, wave_blend);
+            
+        case INSTR_PLUCK:
+            return pluck_wave(x, brightness);
+            
+        case INSTR_BRASS:
+        case INSTR_FLUTE:
+            return harmonic_wave(x, harmonics);
+            
+        case INSTR_STRINGS:
+            // Blend of sawtooth and triangle for strings
+            return sawtooth_wave(x) * 0.6f + triangle_wave(x) * 0.4f;
+            
+        case INSTR_ORGAN:
+            // Blend square and harmonics for organ
+            return square_wave(x) * 0.3f + harmonic_wave(x, harmonics) * 0.7f;
+            
+        case INSTR_BELL:
+            return bell_wave(x, harmonics);
+            
+        case INSTR_BASS:
+            // Deep bass sound (blend of sine and square)
+            return sinf(x) * (1.0f - wave_blend) + square_wave(x) * wave_blend * 0.7f;
+            
+        case INSTR_WURLITZER:
+            // Electric piano sound (blend of triangle and bell)
+            return triangle_wave(x) * 0.6f + bell_wave(x, harmonics * 0.3f) * 0.4f;
+            
+        case INSTR_ACID:
+            // Acid bassline with resonant filter effect
+            return acid_wave(x, brightness, wave_blend);
+            
+        default:
+            return sinf(x);
+    }
+}
+
+// Band-limited wavetables (see Wavetable in whistler.h)
+Wavetable *wavetables[10];  // Built on first use, one per instrument
+
+float *wavetable_at(const Wavetable *wt, int slice, int level) {
+    return wt->tables + ((sf_count_t)slice * WAVETABLE_LEVELS + level) * (WAVETABLE_SIZE + 1);
+}
+
+// Sample one cycle of the instrument waveform and make its mip levels
+void wavetable_fill(Wavetable *wt, int slice, int instrument, float brightness,
+                   float *cycle, fftwf_complex *spectrum, fftwf_complex *scratch,
+                   fftwf_plan forward, fftwf_plan inverse) {
+    const InstrumentPreset *preset = &presets[instrument];
+    
+    for (int i = 0; i < WAVETABLE_SIZE; i++) {
+        float x = 2.0f * (float)M_PI * i / WAVETABLE_SIZE;
+        cycle[i] = instrument_wave(x, instrument, preset->wave_blend, brightness, preset->harmonics);
+    }
+    fftwf_execute_dft_r2c(forward, cycle, spectrum);
+    
+    for (int level = 0; level < WAVETABLE_LEVELS; level++) {
+        int max_harmonic = WAVETABLE_MAX_HARMONICS >> level;
+        
+        // Keep harmonics up to the limit for this level (c2r trashes its input, so copy)
+        for (int k = 0; k <= WAVETABLE_SIZE / 2; k++) {
+            float keep = (k <= max_harmonic) ? 1.0f / WAVETABLE_SIZE : 0.0f;
+            scratch[k][0] = spectrum[k][0] * keep;
+            scratch[k][1] = spectrum[k][1] * keep;
+        }
+        
+        float *table = wavetable_at(wt, slice, level);
+        fftwf_execute_dft_c2r(inverse, scratch, table);
+        table[WAVETABLE_SIZE] = table[0];
+    }
+}
+
+// Build the tables for one instrument
+Wavetable *wavetable_build(int instrument) {
+    const InstrumentPreset *preset = &presets[instrument];
+    Wavetable *wt = (Wavetable*)calloc(1, sizeof(Wavetable));
+    if (!wt) return NULL;
+    
+    // Brightness reaches the waveform as preset brightness times the filter sweep,
+    // which swings between 0.5 -/+ half the filter modulation depth
+    float swing = 0.5f * fabsf(preset->filter_mod);
+    wt->slices = 1;
+    wt->slice_low = preset->brightness;
+    if (instrument == INSTR_PLUCK) {
+        wt->slices = WAVETABLE_SLICES;
+        wt->slice_low = preset->brightness * (0.5f - swing);
+        wt->slice_step = preset->brightness * 2.0f * swing / (WAVETABLE_SLICES - 1);
+    } else if (instrument == INSTR_ACID) {
+        wt->brightness_gain = 1;
+        wt->slice_low = 1.0f;
+    }
+    
+    wt->tables = (float*)malloc(sizeof(float) * wt->slices * WAVETABLE_LEVELS * (WAVETABLE_SIZE + 1));
+    float *cycle = (float*) fftwf_malloc(sizeof(float) * WAVETABLE_SIZE);
+    fftwf_complex *spectrum = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * (WAVETABLE_SIZE/2 + 1));
+    fftwf_complex *scratch = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * (WAVETABLE_SIZE/2 + 1));
+    if (!wt->tables || !cycle || !spectrum || !scratch) {
+        free(wt->tables);
+        free(wt);
+        fftwf_free(cycle);
+        fftwf_free(spectrum);
+        fftwf_free(scratch);
+        return NULL;
+    }
+    
+    // The tables themselves are unaligned rows, so plan for that
+    pthread_mutex_lock(&fftw_planner_lock);
+    fftwf_plan forward = fftwf_plan_dft_r2c_1d(WAVETABLE_SIZE, cycle, spectrum, FFTW_ESTIMATE);
+    fftwf_plan inverse = fftwf_plan_dft_c2r_1d(WAVETABLE_SIZE, scratch, wt->tables, FFTW_ESTIMATE | FFTW_UNALIGNED);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    for (int slice = 0; slice < wt->slices; slice++) {
+        float brightness = wt->slice_low + slice * wt->slice_step;
+        wavetable_fill(wt, slice, instrument, brightness, cycle, spectrum, scratch, forward, inverse);
+    }
+    pthread_mutex_lock(&fftw_planner_lock);
+    fftwf_destroy_plan(forward);
+    fftwf_destroy_plan(inverse);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    fftwf_free(cycle);
+    fftwf_free(spectrum);
+    fftwf_free(scratch);
+    return wt;
+}
+
+// Tables for an instrument, built on first use. Safe to call from several
+// render threads at once; the first caller builds, the rest wait for it.
+const Wavetable *wavetable_get(int instrument) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&lock);
+    if (!wavetables[instrument]) {
+        wavetables[instrument] = wavetable_build(instrument);
+    }
+    Wavetable *wt = wavetables[instrument];
+    pthread_mutex_unlock(&lock);
+    return wt;
+}
+
+// Pick the mip level that keeps every harmonic below Nyquist. `ratio` is the
+// oscillator frequency times WAVETABLE_MAX_HARMONICS * 2 / samplerate.
+int wavetable_level(float ratio) {
+    // Level k holds WAVETABLE_MAX_HARMONICS >> k harmonics, so we want the smallest k
+    // with that at most (samplerate / 2) / frequency: k = ceil(log2(ratio))
+    if (ratio <= 1.0f) return 0;
+    int e;
+    float m = frexpf(ratio, &e);
+    int level = (m == 0.5f) ? e - 1 : e;
+    return level < WAVETABLE_LEVELS ? level : WAVETABLE_LEVELS - 1;
+}
+
+// Which two brightness slices to crossfade between, and how far
+void wavetable_slice(const Wavetable *wt, float brightness, int *slice, float *frac) {
+    if (wt->slices == 1) {
+        *slice = 0;
+        *frac = 0.0f;
+        return;
+    }
+    float slice_pos = wt->slice_step > 0.0f ? (brightness - wt->slice_low) / wt->slice_step : 0.0f;
+    if (slice_pos < 0.0f) slice_pos = 0.0f;
+    if (slice_pos > wt->slices - 1) slice_pos = (float)(wt->slices - 1);
+    *slice = (int)slice_pos;
+    if (*slice >= wt->slices - 1) *slice = wt->slices - 2;
+    *frac = slice_pos - *slice;
+}
+
+// Linearly interpolated read of one table at phase x (cycles, 0 to 1)
+float wavetable_lookup(const float *table, float x) {
+    float pos = x * WAVETABLE_SIZE;
+    int idx = (int)pos;
+    if (idx > WAVETABLE_SIZE - 1) idx = WAVETABLE_SIZE - 1;
+    float frac = pos - idx;
+    return table[idx] + (table[idx + 1] - table[idx]) * frac;
+}
+
+// The kernels below are written once as inline bodies taking the instrument's
+// shape as parameters: the exported kernels pass the wavetable's (and all four
+// lanes), and the per-instrument synth kernels pass constants, so the compiler
+// drops the branches and lanes that instrument never uses.
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+// Band-limited replacement for instrument_wave() - x is the phase in cycles,
+// `level` comes from wavetable_level() and slice/slice_frac from wavetable_slice().
+// `sliced` and `brightness_gain` are the wavetable's shape (slices > 1, brightness_gain).
+KERNEL_INLINE float wavetable_wave(const Wavetable *wt, float x, int level, int slice, float slice_frac,
+                                   float brightness, const int sliced, const int brightness_gain) {
+    float result = wavetable_lookup(wavetable_at(wt, slice, level), x);
+    
+    // Crossfade towards the next brightness slice
+    if (sliced) {
+        float next = wavetable_lookup(wavetable_at(wt, slice + 1, level), x);
+        result = result + (next - result) * slice_frac;
+    }
+    if (brightness_gain) {
+        result *= brightness;
+    }
+    return result;
+}
+
+void osc_bank_init(OscBank *bank, const InstrumentPreset *preset) {
+    int num_oscillators = preset->num_oscillators;
+    memset(bank, 0, sizeof(OscBank));
+    
+    // Root, slightly sharp, slightly flat, octave below
+    float ratios[4] = {1.0f,
+                       semitones_to_multiplier(preset->detune_amount),
+                       semitones_to_multiplier(-preset->detune_amount),
+                       0.5f};
+    for (int osc = 0; osc < num_oscillators && osc < 4; osc++) {
+        bank->ratio[osc] = ratios[osc];
+        // Lower volume for the sub-oscillator
+        if (num_oscillators == 1) {
+            bank->mix[osc] = 1.0f;
+        } else {
+            bank->mix[osc] = (osc == 3) ? preset->octave_mix : (1.0f - preset->octave_mix) / (num_oscillators - 1);
+        }
+    }
+}
+
+KERNEL_INLINE void osc_bank_scalar_body(OscBank *bank, const Wavetable *wt, const float *freq,
+                                        const float *brightness, float *out, int frames, int samplerate,
+                                        const int oscillators, const int sliced, const int brightness_gain) {
+    float inv_samplerate = 1.0f / samplerate;
+    float level_scale = WAVETABLE_MAX_HARMONICS * 2.0f / samplerate;
+    
+    for (int n = 0; n < frames; n++) {
+        int slice = 0;
+        float slice_frac = 0.0f;
+        if (sliced) wavetable_slice(wt, brightness[n], &slice, &slice_frac);
+        
+        // Unused lanes have zero mix and ratio, so they'd only ever add zero
+        float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int osc = 0; osc < oscillators; osc++) {
+            float osc_freq = freq[n] * bank->ratio[osc];
+            float phase = bank->phase[osc] + osc_freq * inv_samplerate;
+            phase -= (float)(int)phase;  // Wrap to 0-1
+            bank->phase[osc] = phase;
+            
+            int level = wavetable_level(osc_freq * level_scale);
+            lanes[osc] = wavetable_wave(wt, phase, level, slice, slice_frac, brightness[n], sliced,
+                                        brightness_gain) * bank->mix[osc];
+        }
+        out[n] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+}
+
+void osc_bank_scalar(OscBank *bank, const Wavetable *wt, const float *freq,
+                     const float *brightness, float *out, int frames, int samplerate) {
+    osc_bank_scalar_body(bank, wt, freq, brightness, out, frames, samplerate, 4, wt->slices > 1,
+                         wt->brightness_gain);
+}
+
+#ifdef HAVE_X86_SIMD
+// Mip level of four oscillators at once: ceil(log2(ratio)) straight from the
+// float's exponent and mantissa bits, clamped to the available levels
+static inline __m128i osc_bank_levels(__m128 ratio) {
+    __m128i bits = _mm_castps_si128(ratio);
+    __m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    __m128i exact = _mm_cmpeq_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFF)), _mm_setzero_si128());
+    __m128i level = _mm_add_epi32(exponent, _mm_add_epi32(exact, _mm_set1_epi32(1)));  // +1 unless a power of two
+    __m128i low = _mm_cmplt_epi32(level, _mm_setzero_si128());
+    level = _mm_andnot_si128(low, level);
+    __m128i top = _mm_set1_epi32(WAVETABLE_LEVELS - 1);
+    __m128i high = _mm_cmpgt_epi32(level, top);
+    return _mm_or_si128(_mm_and_si128(high, top), _mm_andnot_si128(high, level));
+}
+
+// Shared setup for the x86 kernels: advance the four phases (wrap by masking off
+// the integer part) and work out each lane's table offset and interpolation fraction
+static inline __m128 osc_bank_step(__m128 *phase, __m128 ratio, float freq, __m128 inv_samplerate,
+                                   __m128 level_scale, int slice_offset, __m128i *offset) {
+    __m128 osc_freq = _mm_mul_ps(_mm_set1_ps(freq), ratio);
+    __m128 p = _mm_add_ps(*phase, _mm_mul_ps(osc_freq, inv_samplerate));
+    p = _mm_sub_ps(p, _mm_cvtepi32_ps(_mm_cvttps_epi32(p)));
+    *phase = p;
+    
+    __m128i level = osc_bank_levels(_mm_mul_ps(osc_freq, level_scale));
+    __m128 pos = _mm_mul_ps(p, _mm_set1_ps((float)WAVETABLE_SIZE));
+    __m128i idx = _mm_cvttps_epi32(pos);
+    __m128i last = _mm_set1_epi32(WAVETABLE_SIZE - 1);
+    __m128i over = _mm_cmpgt_epi32(idx, last);
+    idx = _mm_or_si128(_mm_and_si128(over, last), _mm_andnot_si128(over, idx));
+    __m128 frac = _mm_sub_ps(pos, _mm_cvtepi32_ps(idx));
+    
+    // level * (WAVETABLE_SIZE + 1) without SSE4.1's 32-bit multiply: shift and add
+    __m128i row = _mm_add_epi32(_mm_slli_epi32(level, WAVETABLE_SIZE_BITS), level);
+    *offset = _mm_add_epi32(_mm_add_epi32(row, idx), _mm_set1_epi32(slice_offset));
+    return frac;
+}
+
+// The table samples at off[lane] + ahead for the oscillators in use (zero for the rest)
+static inline __m128 osc_bank_read(const float *t, const int *off, int ahead, int oscillators) {
+    return _mm_set_ps(oscillators > 3 ? t[off[3] + ahead] : 0.0f, oscillators > 2 ? t[off[2] + ahead] : 0.0f,
+                      oscillators > 1 ? t[off[1] + ahead] : 0.0f, t[off[0] + ahead]);
+}
+
+static inline float osc_bank_sum(__m128 v) {
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];  // Same order as the scalar kernel
+}
+
+// SSE2: vector phase/level/index maths, with the table reads done by hand (and
+// only for the lanes in use)
+KERNEL_INLINE void osc_bank_sse2_body(OscBank *bank, const Wavetable *wt, const float *freq,
+                                      const float *brightness, float *out, int frames, int samplerate,
+                                      const int oscillators, const int sliced, const int brightness_gain) {
+    __m128 phase = _mm_loadu_ps(bank->phase);
+    __m128 ratio = _mm_loadu_ps(bank->ratio);
+    __m128 mix = _mm_loadu_ps(bank->mix);
+    __m128 inv_samplerate = _mm_set1_ps(1.0f / samplerate);
+    __m128 level_scale = _mm_set1_ps(WAVETABLE_MAX_HARMONICS * 2.0f / samplerate);
+    const int slice_stride = WAVETABLE_LEVELS * (WAVETABLE_SIZE + 1);
+    int off[4];
+    
+    for (int n = 0; n < frames; n++) {
+        int slice = 0;
+        float slice_frac = 0.0f;
+        if (sliced) wavetable_slice(wt, brightness[n], &slice, &slice_frac);
+        
+        __m128i offset;
+        __m128 frac = osc_bank_step(&phase, ratio, freq[n], inv_samplerate, level_scale,
+                                    slice * slice_stride, &offset);
+        _mm_storeu_si128((__m128i*)off, offset);
+        
+        const float *t = wt->tables;
+        __m128 a = osc_bank_read(t, off, 0, oscillators);
+        __m128 b = osc_bank_read(t, off, 1, oscillators);
+        __m128 result = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+        
+        if (sliced) {
+            t += slice_stride;
+            a = osc_bank_read(t, off, 0, oscillators);
+            b = osc_bank_read(t, off, 1, oscillators);
+            __m128 next = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_sub_ps(next, result), _mm_set1_ps(slice_frac)));
+        }
+        if (brightness_gain) {
+            result = _mm_mul_ps(result, _mm_set1_ps(brightness[n]));
+        }
+        out[n] = osc_bank_sum(_mm_mul_ps(result, mix));
+    }
+    _mm_storeu_ps(bank->phase, phase);
+}
+
+void osc_bank_sse2(OscBank *bank, const Wavetable *wt, const float *freq,
+                   const float *brightness, float *out, int frames, int samplerate) {
+    osc_bank_sse2_body(bank, wt, freq, brightness, out, frames, samplerate, 4, wt->slices > 1,
+                       wt->brightness_gain);
+}
+
+// AVX2: as SSE2, but the table reads are hardware gathers (of all four lanes)
+__attribute__((target("avx2")))
+KERNEL_INLINE void osc_bank_avx2_body(OscBank *bank, const Wavetable *wt, const float *freq,
+                                      const float *brightness, float *out, int frames, int samplerate,
+                                      const int sliced, const int brightness_gain) {
+    __m128 phase = _mm_loadu_ps(bank->phase);
+    __m128 ratio = _mm_loadu_ps(bank->ratio);
+    __m128 mix = _mm_loadu_ps(bank->mix);
+    __m128 inv_samplerate = _mm_set1_ps(1.0f / samplerate);
+    __m128 level_scale = _mm_set1_ps(WAVETABLE_MAX_HARMONICS * 2.0f / samplerate);
+    const int slice_stride = WAVETABLE_LEVELS * (WAVETABLE_SIZE + 1);
+    const __m128i one = _mm_set1_epi32(1);
+    
+    for (int n = 0; n < frames; n++) {
+        int slice = 0;
+        float slice_frac = 0.0f;
+        if (sliced) wavetable_slice(wt, brightness[n], &slice, &slice_frac);
+        
+        __m128i offset;
+        __m128 frac = osc_bank_step(&phase, ratio, freq[n], inv_samplerate, level_scale,
+                                    slice * slice_stride, &offset);
+        
+        __m128 a = _mm_i32gather_ps(wt->tables, offset, 4);
+        __m128 b = _mm_i32gather_ps(wt->tables, _mm_add_epi32(offset, one), 4);
+        __m128 result = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+        
+        if (sliced) {
+            __m128i next_offset = _mm_add_epi32(offset, _mm_set1_epi32(slice_stride));
+            a = _mm_i32gather_ps(wt->tables, next_offset, 4);
+            b = _mm_i32gather_ps(wt->tables, _mm_add_epi32(next_offset, one), 4);
+            __m128 next = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+            result = _mm_add_ps(result, _mm_mul_ps(_mm_sub_ps(next, result), _mm_set1_ps(slice_frac)));
+        }
+        if (brightness_gain) {
+            result = _mm_mul_ps(result, _mm_set1_ps(brightness[n]));
+        }
+        out[n] = osc_bank_sum(_mm_mul_ps(result, mix));
+    }
+    _mm_storeu_ps(bank->phase, phase);
+}
+
+__attribute__((target("avx2")))
+void osc_bank_avx2(OscBank *bank, const Wavetable *wt, const float *freq,
+                   const float *brightness, float *out, int frames, int samplerate) {
+    osc_bank_avx2_body(bank, wt, freq, brightness, out, frames, samplerate, wt->slices > 1, wt->brightness_gain);
+}
+#endif
+
+const char *osc_bank_kernel_names[NUM_OSC_BANK_KERNELS] = {"avx2", "sse2", "scalar"};
+
+// Pick the oscillator bank kernel: "auto" (or NULL) takes the best the CPU supports
+OscBankKernel osc_bank_select(const char *name) {
+    int automatic = !name || STR_COMPARE(name, "auto") == 0;
+#ifdef HAVE_X86_SIMD
+    if ((automatic && __builtin_cpu_supports("avx2")) || (name && STR_COMPARE(name, "avx2") == 0)) {
+        return __builtin_cpu_supports("avx2") ? osc_bank_avx2 : NULL;
+    }
+    if (automatic || STR_COMPARE(name, "sse2") == 0) {
+        return osc_bank_sse2;
+    }
+#endif
+    if (automatic || STR_COMPARE(name, "scalar") == 0) {
+        return osc_bank_scalar;
+    }
+    return NULL;
+}
+
+// Convert semitones to frequency multiplier
+float semitones_to_multiplier(float semitones) {
+    return powf(2.0f, semitones / 12.0f);
+}
+
+// ADSR envelope
+float adsr_envelope(float time, float attack, float decay, float sustain, float release, float note_length) {
+    if (time < attack) {
+        return time / attack; // Attack phase
+    } else if (time < attack + decay) {
+        return 1.0f - (1.0f - sustain) * (time - attack) / decay; // Decay phase
+    } else if (time < note_length) {
+        return sustain; // Sustain phase
+    } else if (time < note_length + release) {
+        return sustain * (1.0f - (time - note_length) / release); // Release phase
+    } else {
+        return 0.0f; // Note ended
+    }
+}
+
+// Work out where the current window's frequency glide ends
+void synth_begin_window(Synth *synth) {
+    int w = synth->window;
+    
+    // Keep current frequency if amplitude is below threshold
+    synth->next_frequency = synth->current_frequency;
+    if (synth->freq_data[w & synth->freq_mask].amplitude > AMP_THRESHOLD && w < synth->num_windows - 1) {
+        synth->next_frequency = synth->freq_data[(w + 1) & synth->freq_mask].frequency;
+    }
+}
+
+// Advance the LFOs by `steps` frames and evaluate every control at `position`
+void synth_control_point(Synth *synth, sf_count_t position, int steps, ControlValues *values) {
+    const InstrumentPreset *preset = synth->preset;
+    
+    // Calculate envelope
+    float env_time = (float)position / synth->samplerate;
+    values->envelope = adsr_envelope(env_time, preset->attack_time, preset->decay_time,
+                                     preset->sustain_level, preset->release_time, synth->release_start);
+    
+    // Update chorus LFO
+    synth->chorus_phase += steps * synth->chorus_lfo_rate;
+    while (synth->chorus_phase >= 2.0f * M_PI) synth->chorus_phase -= 2.0f * M_PI;
+    values->chorus_mod = preset->chorus_depth * sinf(synth->chorus_phase);
+    
+    // Update filter modulation
+    synth->filter_phase += steps * synth->filter_lfo_rate;
+    while (synth->filter_phase >= 2.0f * M_PI) synth->filter_phase -= 2.0f * M_PI;
+    values->filter_mod_amount = 0.5f + 0.5f * sinf(synth->filter_phase) * preset->filter_mod;
+    
+    // Update tremolo if used
+    values->tremolo_amount = 1.0f;
+    if (preset->tremolo_rate > 0.0f) {
+        synth->tremolo_phase += steps * synth->tremolo_lfo_rate;
+        while (synth->tremolo_phase >= 2.0f * M_PI) synth->tremolo_phase -= 2.0f * M_PI;
+        values->tremolo_amount = 1.0f - preset->tremolo_depth * (0.5f + 0.5f * sinf(synth->tremolo_phase));
+    }
+}
+
+int synth_init(Synth *synth, int instrument, const FrequencyPoint *freq_data, int num_windows,
+               sf_count_t total_frames, int samplerate, float freq_multiplier, OscBankKernel kernel,
+               int control_block) {
+    memset(synth, 0, sizeof(Synth));
+    synth->preset = &presets[instrument];
+    synth->kernel = kernel;
+    osc_bank_init(&synth->bank, synth->preset);
+    synth->instrument = instrument;
+    synth->wavetable = wavetable_get(instrument);
+    if (!synth->wavetable) return 1;
+    synth->render = synth_render_select(instrument, kernel, synth->wavetable);
+    synth->freq_data = freq_data;
+    synth->freq_mask = -1;
+    synth->num_windows = num_windows;
+    synth->total_frames = total_frames;
+    synth->samplerate = samplerate;
+    synth->freq_multiplier = freq_multiplier;
+    synth->current_frequency = freq_data[0].frequency;
+    synth->smooth_amp = 0.0f;  // Start with zero amplitude
+    
+    const InstrumentPreset *preset = synth->preset;
+    synth->chorus_lfo_rate = 2.0f * M_PI * preset->chorus_rate / samplerate;
+    synth->filter_lfo_rate = 2.0f * M_PI * 0.1f / samplerate;  // 0.1 Hz filter sweep
+    synth->tremolo_lfo_rate = 2.0f * M_PI * preset->tremolo_rate / samplerate;
+    
+    // Ensure release phase starts at an appropriate time, especially for long release times
+    float note_length = (float)total_frames / samplerate;
+    synth->release_start = note_length - preset->release_time * 1.5f;
+    if (synth->release_start < preset->attack_time + preset->decay_time) {
+        // If the file is very short, adjust to ensure we still hear something
+        synth->release_start = preset->attack_time + preset->decay_time + 0.1f;
+    }
+    
+    // The LFOs have already taken one step by the first frame
+    synth->control_block = control_block;
+    synth->control_step = 1.0f / control_block;
+    synth_control_point(synth, 0, 1, &synth->control_from);
+    synth_control_point(synth, control_block, control_block, &synth->control_to);
+    
+    if (chorus_init(&synth->chorus, samplerate, preset->chorus_mix)) return 1;
+    
+    synth_begin_window(synth);
+    return 0;
+}
+
+void synth_free(Synth *synth) {
+    chorus_free(&synth->chorus);
+}
+
+// Render the next `frames` mono frames (chorus already mixed in). Per-sample pitch,
+// brightness and gain are worked out first for a sub-block, then the oscillator
+// bank kernel renders the whole sub-block in one go. The instrument's shape comes
+// in as parameters (constants in the specialised kernels): controls it doesn't
+// use are never ramped, and brightness is only worked out if its tables read it.
+KERNEL_INLINE void synth_render_body(Synth *synth, float *out, int frames, OscBankKernel kernel,
+                                     const int tremolo, const int chorus, const int sliced,
+                                     const int brightness_gain) {
+    float brightness = synth->preset->brightness;
+    int samplerate = synth->samplerate;
+    sf_count_t total_frames = synth->total_frames;
+    
+    float freq[SYNTH_BLOCK];            // Transposed voice pitch
+    float bright[SYNTH_BLOCK];          // Filter-swept brightness
+    float gain[SYNTH_BLOCK];            // Amplitude, envelope and tremolo
+    float chorus_delay[SYNTH_BLOCK];    // Chorus delay in frames, swept by its LFO
+    float raw[SYNTH_BLOCK];             // Summed oscillators
+    
+    // The chorus runs a sub-block at a time inside the synth's span, so its time
+    // is summed here and moved over to its own stage at the end
+    int64_t start = profile_begin();
+    int64_t chorus_ns = 0;
+    int chorus_calls = 0;
+    for (int block_start = 0; block_start < frames; block_start += SYNTH_BLOCK) {
+        int block_frames = frames - block_start < SYNTH_BLOCK ? frames - block_start : SYNTH_BLOCK;
+        
+        for (int n = 0; n < block_frames; n++) {
+            int w = synth->window;
+            sf_count_t start_frame = (sf_count_t)w * HOP_SIZE;
+            sf_count_t end_frame = (w == synth->num_windows - 1) ? total_frames : (sf_count_t)(w + 1) * HOP_SIZE;
+            sf_count_t current_sample = synth->position;
+            int i = (int)(current_sample - start_frame);
+            
+            float progress = (float)i / (end_frame - start_frame);
+            float frequency = synth->current_frequency * (1.0f - progress) + synth->next_frequency * progress;
+            
+            // Apply frequency multiplier (transposition)
+            freq[n] = frequency * synth->freq_multiplier;
+            
+            // Smooth amplitude transitions
+            synth->smooth_amp = synth->smooth_amp * (1.0f - AMP_SMOOTH) + synth->freq_data[w & synth->freq_mask].amplitude * AMP_SMOOTH;
+            
+            // Start a new control block once the last one has been ramped across
+            if (synth->control_pos == synth->control_block) {
+                synth->control_from = synth->control_to;
+                synth_control_point(synth, current_sample + synth->control_block, synth->control_block,
+                                    &synth->control_to);
+                synth->control_pos = 0;
+            }
+            
+            // Ramp the controls linearly across the control block
+            const ControlValues *from = &synth->control_from;
+            const ControlValues *to = &synth->control_to;
+            float t = synth->control_pos * synth->control_step;
+            float envelope = from->envelope + (to->envelope - from->envelope) * t;
+            float tremolo_amount = 1.0f;  // What the ramp gives without tremolo
+            if (tremolo) {
+                tremolo_amount = from->tremolo_amount + (to->tremolo_amount - from->tremolo_amount) * t;
+            }
+            if (chorus) {
+                float chorus_mod = from->chorus_mod + (to->chorus_mod - from->chorus_mod) * t;
+                chorus_delay[n] = (CHORUS_DELAY + CHORUS_SWEEP * chorus_mod) * samplerate;
+            }
+            if (sliced || brightness_gain) {
+                float filter_mod_amount = from->filter_mod_amount +
+                                          (to->filter_mod_amount - from->filter_mod_amount) * t;
+                bright[n] = brightness * filter_mod_amount;
+            }
+            synth->control_pos++;
+            
+            // Envelope, amplitude and tremolo
+            gain[n] = synth->smooth_amp * envelope * MASTER_VOLUME * tremolo_amount;
+            
+            // Move on, crossing into the next window when this one is done
+            synth->position++;
+            if (synth->position >= end_frame && w < synth->num_windows - 1) {
+                synth->current_frequency = synth->next_frequency;
+                synth->window++;
+                synth_begin_window(synth);
+            }
+        }
+        
+        // Generate multi-oscillator sound
+        kernel(&synth->bank, synth->wavetable, freq, bright, raw, block_frames, samplerate);
+        
+        for (int n = 0; n < block_frames; n++) {
+            out[block_start + n] = raw[n] * gain[n];
+        }
+        if (chorus) {
+            int64_t chorus_start = profile_begin();
+            chorus_process(&synth->chorus, out + block_start, chorus_delay, block_frames);
+            if (chorus_start) {
+                chorus_ns += profile_now() - chorus_start;
+                chorus_calls++;
+            }
+        }
+    }
+    profile_end(PROFILE_SYNTH, start);
+    if (chorus_calls > 0) {
+        profile_add(PROFILE_SYNTH, -chorus_ns, 0);
+        profile_add(PROFILE_CHORUS, chorus_ns, chorus_calls);
+    }
+}
+
+// Any instrument on any oscillator kernel, with its shape looked up as it goes
+static void synth_render_generic(Synth *synth, float *out, int frames) {
+    const Wavetable *wt = synth->wavetable;
+    synth_render_body(synth, out, frames, synth->kernel, synth->preset->tremolo_rate > 0.0f,
+                      synth->preset->chorus_mix > 0.0f, wt->slices > 1, wt->brightness_gain);
+}
+
+// Each instrument's shape as compile-time constants: oscillators in the bank,
+// tremolo, chorus, brightness slices (the filter sweep reshapes the wave) and
+// brightness gain (it scales it). synth_init checks them against the preset and
+// wavetable, and renders generically if they've drifted apart.
+#define SYNTH_INSTRUMENTS(X) \
+    X(pad,       INSTR_PAD,       4, 1, 1, 0, 0) \
+    X(pluck,     INSTR_PLUCK,     2, 0, 1, 1, 0) \
+    X(brass,     INSTR_BRASS,     2, 0, 1, 0, 0) \
+    X(flute,     INSTR_FLUTE,     2, 1, 1, 0, 0) \
+    X(strings,   INSTR_STRINGS,   3, 1, 1, 0, 0) \
+    X(organ,     INSTR_ORGAN,     3, 1, 1, 0, 0) \
+    X(bell,      INSTR_BELL,      2, 0, 0, 0, 0) \
+    X(bass,      INSTR_BASS,      2, 0, 0, 0, 0) \
+    X(wurlitzer, INSTR_WURLITZER, 2, 1, 1, 0, 0) \
+    X(acid,      INSTR_ACID,      2, 0, 0, 0, 1)
+
+typedef struct {
+    int oscillators;
+    int tremolo;
+    int chorus;
+    int sliced;
+    int brightness_gain;
+} SynthShape;
+
+#define SYNTH_SHAPE(name, instrument, oscillators, tremolo, chorus, sliced, gain) \
+    [instrument] = {oscillators, tremolo, chorus, sliced, gain},
+static const SynthShape synth_shapes[NUM_INSTRUMENTS] = { SYNTH_INSTRUMENTS(SYNTH_SHAPE) };
+
+// One oscillator bank kernel and synth kernel per instrument, per SIMD flavour.
+// The synth kernel calls its oscillator kernel directly.
+#define SYNTH_KERNELS(flavour, target, name, instrument, oscillators, tremolo, chorus, sliced, gain) \
+    target static void osc_bank_##flavour##_##name(OscBank *bank, const Wavetable *wt, const float *freq, \
+                                                   const float *brightness, float *out, int frames, \
+                                                   int samplerate) { \
+        OSC_BANK_BODY_##flavour(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain); \
+    } \
+    static void synth_render_##flavour##_##name(Synth *synth, float *out, int frames) { \
+        synth_render_body(synth, out, frames, osc_bank_##flavour##_##name, tremolo, chorus, sliced, gain); \
+    }
+#define OSC_BANK_BODY_scalar(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain) \
+    osc_bank_scalar_body(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain)
+#define SYNTH_KERNELS_scalar(...) SYNTH_KERNELS(scalar, , __VA_ARGS__)
+#define SYNTH_RENDERER_scalar(name, instrument, ...) [instrument] = synth_render_scalar_##name,
+SYNTH_INSTRUMENTS(SYNTH_KERNELS_scalar)
+
+#ifdef HAVE_X86_SIMD
+#define OSC_BANK_BODY_sse2(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain) \
+    osc_bank_sse2_body(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain)
+#define OSC_BANK_BODY_avx2(bank, wt, freq, brightness, out, frames, samplerate, oscillators, sliced, gain) \
+    osc_bank_avx2_body(bank, wt, freq, brightness, out, frames, samplerate, sliced, gain)
+#define SYNTH_KERNELS_sse2(...) SYNTH_KERNELS(sse2, , __VA_ARGS__)
+#define SYNTH_KERNELS_avx2(...) SYNTH_KERNELS(avx2, __attribute__((target("avx2"))), __VA_ARGS__)
+#define SYNTH_RENDERER_sse2(name, instrument, ...) [instrument] = synth_render_sse2_##name,
+#define SYNTH_RENDERER_avx2(name, instrument, ...) [instrument] = synth_render_avx2_##name,
+SYNTH_INSTRUMENTS(SYNTH_KERNELS_sse2)
+SYNTH_INSTRUMENTS(SYNTH_KERNELS_avx2)
+#endif
+
+// The specialised synth kernels, by oscillator kernel and instrument
+typedef struct {
+    OscBankKernel kernel;
+    SynthRenderKernel render[NUM_INSTRUMENTS];
+} SynthKernelTable;
+
+static const SynthKernelTable synth_kernels[] = {
+#ifdef HAVE_X86_SIMD
+    {osc_bank_avx2, { SYNTH_INSTRUMENTS(SYNTH_RENDERER_avx2) }},
+    {osc_bank_sse2, { SYNTH_INSTRUMENTS(SYNTH_RENDERER_sse2) }},
+#endif
+    {osc_bank_scalar, { SYNTH_INSTRUMENTS(SYNTH_RENDERER_scalar) }},
+};
+
+// Pick the synth kernel for an instrument on an oscillator kernel: the specialised
+// one if its constants still describe the instrument, otherwise the generic one
+SynthRenderKernel synth_render_select(int instrument, OscBankKernel kernel, const Wavetable *wt) {
+    const InstrumentPreset *preset = &presets[instrument];
+    const SynthShape *shape = &synth_shapes[instrument];
+    int matches = shape->oscillators == preset->num_oscillators &&
+                  shape->tremolo == (preset->tremolo_rate > 0.0f) &&
+                  shape->chorus == (preset->chorus_mix > 0.0f) &&
+                  shape->sliced == (wt->slices > 1) &&
+                  shape->brightness_gain == wt->brightness_gain;
+    for (size_t k = 0; matches && k < sizeof(synth_kernels) / sizeof(synth_kernels[0]); k++) {
+        if (synth_kernels[k].kernel == kernel) return synth_kernels[k].render[instrument];
+    }
+    return synth_render_generic;
+}
+
+void synth_render(Synth *synth, float *out, int frames) {
+    synth->render(synth, out, frames);
+}
+
+// Create a function to get instrument index by name
+int get_instrument_by_name(const char *name) {
+    const char *names[] = {
+        "pad", "pluck", "brass", "flute", "strings", 
+        "organ", "bell", "bass", "wurlitzer", "acid"
+    };
+    
+    // Also accept full names with case insensitivity
+    const char *full_names[] = {
+        "lush pad", "plucked string", "brass", "flute", "strings", 
+        "organ", "bell", "bass", "wurlitzer", "acid"
+    };
+    
+    for (int i = 0; i < 10; i++) {
+        if (STR_COMPARE(name, names[i]) == 0 || STR_COMPARE(name, full_names[i]) == 0) {
+            return i;
+        }
+    }
+    
+    // Not found - try to convert to a number
+    char *endptr;
+    int idx = (int)strtol(name, &endptr, 10);
+    
+    // If conversion successful and in range, return it
+    if (*name != '\0' && *endptr == '\0' && idx >= 0 && idx <= 9) {
+        return idx;
+    }
+    
+    // Invalid instrument
+    return -1;
+}
+
+// Instrument presets
+const InstrumentPreset presets[] = {
+    // INSTR_PAD (0) - Lush pad sound
+    {
+        .num_oscillators = 4,
+        .detune_amount = 0.12f,        // Increased detune for wider sound
+        .attack_time = 0.8f,           // Much longer attack for slow fade-in
+        .decay_time = 0.5f,            // Longer decay
+        .sustain_level = 0.7f,         // Slightly lower sustain for warmth
+        .release_time = 1.2f,          // Much longer release for slow fade-out
+        .octave_mix = 0.4f,            // More sub-octave for fullness
+        .chorus_rate = 0.12f,          // Slower chorus for smoother movement
+        .chorus_depth = 0.6f,          // Deeper chorus for more richness
+        .chorus_mix = 0.5f,            // More chorus for fuller sound
+        .reverb_mix = 0.6f,            // More reverb for spaciousness
+        .wave_blend = 0.25f,           // More sine content for roundness
+        .brightness = 0.5f,            // Lower brightness to reduce harshness
+        .harmonics = 0.3f,             // Fewer harmonics for smoothness
+        .tremolo_rate = 0.7f,          // Slow tremolo for gentle undulation
+        .tremolo_depth = 0.08f,        // Subtle tremolo depth
+        .filter_mod = 0.2f             // Gentle filter modulation
+    },
+    
+    // INSTR_PLUCK (1) - Plucked string sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.01f,
+        .attack_time = 0.01f,
+        .decay_time = 0.3f,
+        .sustain_level = 0.2f,
+        .release_time = 0.1f,
+        .octave_mix = 0.1f,
+        .chorus_rate = 0.5f,
+        .chorus_depth = 0.2f,
+        .chorus_mix = 0.2f,
+        .reverb_mix = 0.3f,
+        .wave_blend = 0.7f,
+        .brightness = 0.8f,
+        .harmonics = 0.7f,
+        .tremolo_rate = 0.0f,
+        .tremolo_depth = 0.0f,
+        .filter_mod = 0.3f
+    },
+    
+    // INSTR_BRASS (2) - Brass sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.05f,
+        .attack_time = 0.1f,
+        .decay_time = 0.1f,
+        .sustain_level = 0.8f,
+        .release_time = 0.2f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.1f,
+        .chorus_depth = 0.2f,
+        .chorus_mix = 0.1f,
+        .reverb_mix = 0.2f,
+        .wave_blend = 0.8f,
+        .brightness = 0.7f,
+        .harmonics = 0.8f,
+        .tremolo_rate = 0.0f,
+        .tremolo_depth = 0.0f,
+        .filter_mod = 0.2f
+    },
+    
+    // INSTR_FLUTE (3) - Flute/wind sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.03f,
+        .attack_time = 0.15f,
+        .decay_time = 0.1f,
+        .sustain_level = 0.7f,
+        .release_time = 0.15f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.3f,
+        .chorus_depth = 0.3f,
+        .chorus_mix = 0.2f,
+        .reverb_mix = 0.3f,
+        .wave_blend = 0.2f,
+        .brightness = 0.5f,
+        .harmonics = 0.3f,
+        .tremolo_rate = 5.0f,
+        .tremolo_depth = 0.1f,
+        .filter_mod = 0.1f
+    },
+    
+    // INSTR_STRINGS (4) - String section
+    {
+        .num_oscillators = 3,
+        .detune_amount = 0.1f,
+        .attack_time = 0.2f,
+        .decay_time = 0.1f,
+        .sustain_level = 0.7f,
+        .release_time = 0.3f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.3f,
+        .chorus_depth = 0.6f,
+        .chorus_mix = 0.4f,
+        .reverb_mix = 0.5f,
+        .wave_blend = 0.6f,
+        .brightness = 0.6f,
+        .harmonics = 0.5f,
+        .tremolo_rate = 5.5f,
+        .tremolo_depth = 0.2f,
+        .filter_mod = 0.0f
+    },
+    
+    // INSTR_ORGAN (5) - Hammond-like organ
+    {
+        .num_oscillators = 3,
+        .detune_amount = 0.0f,
+        .attack_time = 0.01f,
+        .decay_time = 0.0f,
+        .sustain_level = 1.0f,
+        .release_time = 0.05f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 6.0f,
+        .chorus_depth = 0.3f,
+        .chorus_mix = 0.2f,
+        .reverb_mix = 0.3f,
+        .wave_blend = 0.9f,
+        .brightness = 0.8f,
+        .harmonics = 0.9f,
+        .tremolo_rate = 6.0f,
+        .tremolo_depth = 0.15f,
+        .filter_mod = 0.0f
+    },
+    
+    // INSTR_BELL (6) - Bell/chime sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.01f,
+        .attack_time = 0.01f,
+        .decay_time = 0.5f,
+        .sustain_level = 0.1f,
+        .release_time = 0.8f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.0f,
+        .chorus_depth = 0.0f,
+        .chorus_mix = 0.0f,
+        .reverb_mix = 0.6f,
+        .wave_blend = 0.8f,
+        .brightness = 0.9f,
+        .harmonics = 0.7f,
+        .tremolo_rate = 0.0f,
+        .tremolo_depth = 0.0f,
+        .filter_mod = 0.0f
+    },
+    
+    // INSTR_BASS (7) - Deep bass sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.02f,
+        .attack_time = 0.02f,
+        .decay_time = 0.1f,
+        .sustain_level = 0.8f,
+        .release_time = 0.1f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.0f,
+        .chorus_depth = 0.0f,
+        .chorus_mix = 0.0f,
+        .reverb_mix = 0.1f,
+        .wave_blend = 0.5f,
+        .brightness = 0.4f,
+        .harmonics = 0.3f,
+        .tremolo_rate = 0.0f,
+        .tremolo_depth = 0.0f,
+        .filter_mod = 0.5f
+    },
+    
+    // INSTR_WURLITZER (8) - Electric piano sound
+    {
+        .num_oscillators = 2,
+        .detune_amount = 0.0f,
+        .attack_time = 0.01f,
+        .decay_time = 0.4f,
+        .sustain_level = 0.3f,
+        .release_time = 0.2f,
+        .octave_mix = 0.0f,
+        .chorus_rate = 0.5f,
+        .chorus_depth = 0.2f,
+        .chorus_mix = 0.2f,
+        .reverb_mix = 0.3f,
+        .wave_blend = 0.6f,
+        .brightness = 0.7f,
+        .harmonics = 0.5f,
+        .tremolo_rate = 4.0f,
+        .tremolo_depth = 0.1f,
+        .filter_mod = 0.2f
+    },
+    
+    // INSTR_ACID (9) - Acid/303-style sound
+    {
+        .num_oscillators = 2,         // Use 2 oscillators for more body
+        .detune_amount = 0.01f,       // Very slight detune for thickness
+        .attack_time = 0.01f,         // Fast attack
+        .decay_time = 0.3f,
+        .sustain_level = 0.7f,        // Higher sustain for more presence
+        .release_time = 0.1f,         // Quick release
+        .octave_mix = 0.0f,           // No sub-oscillator
+        .chorus_rate = 0.0f,
+        .chorus_depth = 0.0f,
+        .chorus_mix = 0.0f,           // No chorus
+        .reverb_mix = 0.15f,          // Just a touch of reverb
+        .wave_blend = 0.7f,           // Higher value = more resonance
+        .brightness = 0.9f,           // Very bright filter cutoff
+        .harmonics = 0.0f,
+        .tremolo_rate = 0.0f,
+        .tremolo_depth = 0.0f,
+        .filter_mod = 0.9f            // Strong filter modulation
+    }
+};
+
+// Display names, in INSTR_* order
+const char *instrument_names[] = {
+    "Lush Pad", "Plucked String", "Brass", "Flute", "Strings", 
+    "Organ", "Bell", "Bass", "Wurlitzer", "Acid"
+};
+
+// Command line names, in INSTR_* order
+const char *instrument_short_names[] = {
+    "pad", "pluck", "brass", "flute", "strings", 
+    "organ", "bell", "bass", "wurlitzer", "acid"
+};
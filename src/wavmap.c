@@ -0,0 +1,166 @@
+// wavmap.c - zero-copy input for uncompressed WAV and RF64 files: the file is mapped
+// and only the samples that are asked for get converted (or, for 32-bit float, read
+// in place). Anything else is left to libsndfile.
+#include "whistler.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint32_t read_le16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t read_le32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t read_le64(const unsigned char *p) {
+    return read_le32(p) | (uint64_t)read_le32(p + 4) << 32;
+}
+
+// Parse the header of a mapped file. Returns 0 if it's a WAV/RF64 we can read directly.
+static int wav_map_parse(WavMap *map, const unsigned char *file, size_t size) {
+    if (size < 12 || memcmp(file + 8, "WAVE", 4) != 0) return 1;
+    int rf64 = memcmp(file, "RF64", 4) == 0 || memcmp(file, "BW64", 4) == 0;
+    if (!rf64 && memcmp(file, "RIFF", 4) != 0) return 1;  // RIFX (big-endian) and the rest
+    
+    uint64_t rf64_data_size = 0;
+    int have_format = 0;
+    int tag = 0, bits = 0, block_align = 0;
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const unsigned char *chunk = file + offset;
+        uint64_t chunk_size = read_le32(chunk + 4);
+        const unsigned char *body = chunk + 8;
+        size_t body_size = size - offset - 8;
+        
+        if (memcmp(chunk, "ds64", 4) == 0 && chunk_size >= 24 && body_size >= 24) {
+            rf64_data_size = read_le64(body + 8);
+        } else if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && body_size >= 16) {
+            tag = read_le16(body);
+            map->channels = read_le16(body + 2);
+            map->samplerate = read_le32(body + 4);
+            block_align = read_le16(body + 12);
+            bits = read_le16(body + 14);
+            if (tag == 0xFFFE && chunk_size >= 40 && body_size >= 40) {
+                tag = read_le16(body + 24);  // WAVE_FORMAT_EXTENSIBLE: the sub-format GUID starts with the tag
+            }
+            have_format = 1;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) return 1;
+            if (rf64 && chunk_size == 0xFFFFFFFF) chunk_size = rf64_data_size;
+            if (chunk_size > body_size) chunk_size = body_size;  // Truncated, or still being written
+            
+            map->bytes = bits / 8;
+            map->is_float = tag == 3;
+            int supported = (tag == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) ||
+                            (tag == 3 && (bits == 32 || bits == 64));
+            if (!supported || map->channels < 1 || block_align != map->channels * map->bytes) return 1;
+            
+            map->frame_bytes = block_align;
+            map->data = body;
+            map->frames = (sf_count_t)(chunk_size / block_align);
+            return 0;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1);  // Chunks are padded to even sizes
+    }
+    return 1;
+}
+
+// Map an input file. Returns 0 on success, or 1 if it isn't an uncompressed
+// WAV/RF64 (or can't be mapped), in which case read it with libsndfile instead.
+int wav_map_open(const char *path, WavMap *map) {
+    memset(map, 0, sizeof(WavMap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 1;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 12) {
+        close(fd);
+        return 1;
+    }
+    void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return 1;
+    
+    map->mapping = mapping;
+    map->mapping_size = (size_t)st.st_size;
+    if (wav_map_parse(map, (const unsigned char*)mapping, map->mapping_size)) {
+        wav_map_close(map);
+        return 1;
+    }
+    
+    // The analysis walks the file front to back, one region per thread
+    madvise(mapping, map->mapping_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void wav_map_close(WavMap *map) {
+    if (map->mapping) munmap(map->mapping, map->mapping_size);
+    map->mapping = NULL;
+    map->data = NULL;
+}
+
+// The samples themselves, if they're already native floats that can be read in
+// place (stride: channels), else NULL
+const float *wav_map_floats(const WavMap *map) {
+    const uint32_t probe = 1;
+    int little_endian = *(const unsigned char*)&probe == 1;
+    int aligned = ((uintptr_t)map->data & (sizeof(float) - 1)) == 0;
+    if (map->is_float && map->bytes == 4 && little_endian && aligned) {
+        return (const float*)map->data;
+    }
+    return NULL;
+}
+
+// Drop the mapped pages wholly inside `count` frames from `first` on. They're only
+// unmapped, not discarded, so reading them again just faults them back in.
+void wav_map_release(const WavMap *map, sf_count_t first, sf_count_t count) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(map->data + first * map->frame_bytes);
+    uintptr_t end = start + (uintptr_t)(count * map->frame_bytes);
+    start = (start + page - 1) & ~(page - 1);
+    end &= ~(page - 1);
+    if (end > start) {
+        madvise((void*)start, end - start, MADV_DONTNEED);
+    }
+}
+
+// Convert `count` frames of one channel, from frame `first` on, to float. Scaling
+// matches libsndfile's, so either reader gives the same samples.
+void wav_map_read_channel(const WavMap *map, int channel, sf_count_t first, int count, float *out) {
+    const unsigned char *p = map->data + first * map->frame_bytes + channel * map->bytes;
+    size_t step = map->frame_bytes;
+    
+    if (map->is_float && map->bytes == 4) {
+        for (int i = 0; i < count; i++, p += step) {
+            uint32_t bits = read_le32(p);
+            memcpy(&out[i], &bits, sizeof(float));
+        }
+    } else if (map->is_float) {
+        for (int i = 0; i < count; i++, p += step) {
+            uint64_t bits = read_le64(p);
+            double value;
+            memcpy(&value, &bits, sizeof(double));
+            out[i] = (float)value;
+        }
+    } else if (map->bytes == 1) {
+        for (int i = 0; i < count; i++, p += step) {
+            out[i] = ((int)p[0] - 128) * (1.0f / 0x80);  // 8-bit WAV is unsigned
+        }
+    } else if (map->bytes == 2) {
+        for (int i = 0; i < count; i++, p += step) {
+            out[i] = (int16_t)read_le16(p) * (1.0f / 0x8000);
+        }
+    } else if (map->bytes == 3) {
+        for (int i = 0; i < count; i++, p += step) {
+            int32_t value = (int32_t)(p[0] << 8 | p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+            out[i] = value * (1.0f / 0x800000);
+        }
+    } else {
+        for (int i = 0; i < count; i++, p += step) {
+            out[i] = (int32_t)read_le32(p) * (1.0f / 0x80000000);
+        }
+    }
+}
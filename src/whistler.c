@@ -1,963 +1,762 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sndfile.h>
-#include <fftw3.h>
-#include <math.h>
 #include <string.h>
 #include <ctype.h>  // For isdigit
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include "whistler.h"
+
+#define LIVE_ARRIVALS 4096  // Reads whose arrival times are remembered for latency
+
+// Raw PCM sample formats for --live
+#define LIVE_S16 0
+#define LIVE_F32 1
+const char *live_format_names[] = {"s16", "f32"};
+const int live_format_sizes[] = {2, 4};
+
+// When a read's frames arrived, so each output frame can be timed against the
+// input frame at the same position
+typedef struct {
+    sf_count_t end;             // Frames read in total up to and including this read
+    double time;
+} LiveArrival;
 
-// Use the right string comparison function for the platform
-#if defined(_WIN32) || defined(_WIN64)
-    #define STR_COMPARE _stricmp
-#else
-    #define STR_COMPARE strcasecmp
-#endif
-
-// Core settings
-#define MASTER_VOLUME 0.8f
-#define MIN_FREQUENCY 200.0f
-#define MAX_FREQUENCY 1500.0f
-#define WINDOW_SIZE 1024
-#define HOP_SIZE 128
-#define AMP_SCALE 200.0f
-#define AMP_THRESHOLD 0.05f  // Amplitude threshold for frequency updates
-#define AMP_SMOOTH 0.05f     // Amplitude smoothing factor (0-1)
-
-// Instrument types
-#define INSTR_PAD          0
-#define INSTR_PLUCK        1
-#define INSTR_BRASS        2
-#define INSTR_FLUTE        3
-#define INSTR_STRINGS      4
-#define INSTR_ORGAN        5
-#define INSTR_BELL         6
-#define INSTR_BASS         7
-#define INSTR_WURLITZER    8
-#define INSTR_ACID         9
-
-// Reverb settings - make these variables instead of macros so we can modify them
-float g_reverb_mix = 0.4f;       // Mix of dry/wet (0.0 = dry, 1.0 = wet)
-float g_reverb_decay = 0.8f;     // Decay factor (0.0 to 1.0)
-#define REVERB_DELAY1 1567    // Prime numbers work well for delays
-#define REVERB_DELAY2 2053
-#define REVERB_DELAY3 3001
-#define REVERB_DELAY4 4001
-#define MAX_REVERB_DELAY 4001 // Maximum delay length (must be largest of the above)
-
-// Pad synth settings
-#define NUM_OSCILLATORS 4      // Number of oscillators per voice
-#define DETUNE_AMOUNT 0.08f    // Detune amount in semitones
-#define ATTACK_TIME 0.3f       // Attack time in seconds
-#define RELEASE_TIME 0.5f      // Release time in seconds
-#define OCTAVE_MIX 0.3f        // Amount of lower octave to mix in (0.0 - 1.0)
-#define CHORUS_RATE 0.2f       // Chorus LFO rate in Hz
-#define CHORUS_DEPTH 0.5f      // Chorus depth (0.0 - 1.0)
-#define CHORUS_MIX 0.3f        // Chorus mix (0.0 - 1.0)
+// Set by SIGINT/SIGTERM to stop reading and flush what's left
+volatile sig_atomic_t live_stop = 0;
 
-// Instrument presets - these will be selected based on instrument type
+// One output to render from the input's pitch track
 typedef struct {
-    int num_oscillators;     // Number of oscillators
-    float detune_amount;     // Detune amount in semitones
-    float attack_time;       // Attack time in seconds
-    float decay_time;        // Decay time in seconds
-    float sustain_level;     // Sustain level (0.0-1.0)
-    float release_time;      // Release time in seconds
-    float octave_mix;        // Amount of lower octave to mix in
-    float chorus_rate;       // Chorus LFO rate in Hz
-    float chorus_depth;      // Chorus depth (0.0-1.0)
-    float chorus_mix;        // Chorus mix (0.0-1.0)
-    float reverb_mix;        // Reverb mix (0.0-1.0)
-    float wave_blend;        // Blend between sine (0.0) and complex (1.0)
-    float brightness;        // Brightness factor (filter cutoff)
-    float harmonics;         // Harmonic content (0.0-1.0)
-    float tremolo_rate;      // Tremolo rate in Hz
-    float tremolo_depth;     // Tremolo depth (0.0-1.0)
-    float filter_mod;        // Filter modulation depth
-} InstrumentPreset;
-
-// Structure to store frequency data
+    int instrument;
+    float transpose;
+    float volume;
+    char output_file[256];      // Empty until a default name is filled in
+    int failed;
+} RenderJob;
+
+// Render jobs shared out between threads, all reading the same pitch track
 typedef struct {
-    float frequency;
-    float amplitude;
-} FrequencyPoint;
-
-// Forward declarations for all waveform functions
-float triangle_wave(float x);
-float pad_wave(float x, float blend);
-float soft_sine(float x);
-float square_wave(float x);
-float sawtooth_wave(float x);
-float noise(void);
-float bell_wave(float x, float harmonics);
-float harmonic_wave(float x, float harmonics);
-float pluck_wave(float x, float brightness);
-float acid_wave(float x, float cutoff, float resonance);
-float instrument_wave(float x, int instrument, float wave_blend, float brightness, float harmonics);
-
-// Forward declare the instrument presets array
-extern const InstrumentPreset presets[];
-
-// Simple sine wave generator with soft edges
-float soft_sine(float x) {
-    // Blend between sine and a softer waveform
-    float pure_sine = sinf(x);
-    // Add a small amount of the third harmonic with inverted phase
-    // This reduces the harsh transitions
-    return pure_sine * 0.98f - 0.02f * sinf(3 * x);
-}
-
-float triangle_wave(float x) {
-    const float pi = (float)M_PI;  // Convert M_PI to float explicitly
-    return 2.0f * (fabsf(fmodf(x, 2.0f * pi) - pi) - pi / 2.0f);
-}
-
-float square_wave(float x) {
-    return sinf(x) >= 0.0f ? 1.0f : -1.0f;
-}
-
-float sawtooth_wave(float x) {
-    return 2.0f * (fmodf(x / (2.0f * M_PI), 1.0f) - 0.5f);
-}
+    RenderJob *jobs;
+    int num_jobs;
+    int next;                   // Next job nobody has picked up yet
+    pthread_mutex_t lock;
+    const PitchTrack *track;
+    const RenderOptions *options;
+} RenderQueue;
 
-float noise(void) {
-    return 2.0f * ((float)rand() / RAND_MAX) - 1.0f;
+void print_usage(const char* program_name) {
+    printf("Usage: %s [options] <input_wav_file> [semitones] [instrument] [volume] [output_file]\n", program_name);
+    printf("       %s [options] --render <instrument[:semitones[:volume[:output_file]]]> ... <input_wav_file>\n", program_name);
+    printf("  input_wav_file: Path to the source WAV file\n");
+    printf("  semitones: Transposition amount in semitones (positive or negative)\n");
+    printf("             Default: 0 (no transposition)\n");
+    printf("  instrument: Instrument type (0-9 or name)\n");
+    printf("             0/pad:        Lush Pad\n");
+    printf("             1/pluck:      Plucked String\n");
+    printf("             2/brass:      Brass\n");
+    printf("             3/flute:      Flute\n");
+    printf("             4/strings:    Strings\n");
+    printf("             5/organ:      Organ\n");
+    printf("             6/bell:       Bell\n");
+    printf("             7/bass:       Bass\n");
+    printf("             8/wurlitzer:  Wurlitzer\n");
+    printf("             9/acid:       Acid\n");
+    printf("             Default: 0 (Pad)\n");
+    printf("  volume: Output volume multiplier (0.0-10.0) (optional)\n");
+    printf("             Default: 1.0 (original volume)\n");
+    printf("  output_file: Path to the output WAV file (optional)\n");
+    printf("             Default: <input_basename>_<instrument>_<semitones>.wav\n");
+    printf("Options:\n");
+    printf("  --fft-planner <estimate|measure|patient>: FFTW planning rigour\n");
+    printf("             Default: estimate (measure/patient plan slower but run faster)\n");
+    printf("  --wisdom <file>: Load FFTW wisdom from this file and save it back after planning,\n");
+    printf("             so repeated runs can skip planning\n");
+    printf("  --control-block <N>: Frames between envelope/LFO updates, ramped in between\n");
+    printf("             Default: %d (1 evaluates them every sample)\n", CONTROL_BLOCK);
+    printf("  --analysis-only: Only analyse the input and save its pitch track to <input_wav_file>%s\n",
+           PITCH_TRACK_EXTENSION);
+    printf("  --no-pitch-cache: Always analyse the input, and don't read or write the pitch track file\n");
+    printf("  --pitch-engine <peak|yin|decimated>: How the pitch is detected\n");
+    printf("             peak: loudest bin of a 1024-point FFT (default)\n");
+    printf("             yin: YIN difference function with sub-sample interpolation, on shorter frames\n");
+    printf("             decimated: as peak, on the input filtered and decimated to the pitch range\n");
+    printf("  --adaptive-hop: Analyse every %dth window, and the ones between only where the pitch\n",
+           ADAPTIVE_HOPS);
+    printf("             or level changes; steady stretches are interpolated (not with --live)\n");
+    printf("  --per-channel: Track the pitch of every input channel and give each its own voice,\n");
+    printf("             instead of playing channel 0's on all of them (not with --live)\n");
+    printf("  --simd <auto|avx2|sse2|scalar>: Oscillator bank kernel\n");
+    printf("             Default: auto (the best this CPU supports)\n");
+    printf("  --threads <N>: Number of threads for pitch analysis and for rendering --render outputs\n");
+    printf("             Default: number of cores\n");
+    printf("  --render <instrument[:semitones[:volume[:output_file]]]>: Add an output to render\n");
+    printf("             May be given many times; the input is analysed once for all of them\n");
+    printf("  --manifest <file>: Read --render outputs from a file, one per line ('#' starts a comment)\n");
+    printf("  --live: Read raw PCM from input_wav_file ('-' for stdin, or a FIFO) and write the\n");
+    printf("             synthesized PCM to output_file (default '-', stdout) as it arrives.\n");
+    printf("             Messages go to stderr; latency is reported when the input ends\n");
+    printf("  --rate <Hz>: Sample rate of --live input and output (default: 44100)\n");
+    printf("  --channels <N>: Channels of --live input and output (default: 1)\n");
+    printf("  --sample-format <s16|f32>: Native-endian sample format of --live PCM (default: s16)\n");
+    printf("  --profile <file>: Write time and allocations per stage and per output to this file as JSON\n");
+    printf("  --profile-trace <file>: With --profile, also write every timed span to this file as a\n");
+    printf("             Chrome trace (open it in chrome://tracing or Perfetto)\n");
 }
 
-// Blended waveform for rich pad sound
-float pad_wave(float x, float blend) {
-    float sine = sinf(x);
-    float sine2 = sinf(x * 2.001f) * 0.3f;  // Second partial with slight detuning
-    float sine3 = sinf(x * 0.5f) * 0.4f;    // Sub-oscillator for fullness
-    float tri = triangle_wave(x) * 0.7f;    // Softer triangle component
-    float saw = sawtooth_wave(x) * 0.5f;    // Gentler sawtooth component
-    
-    // Combine sine waves for a complex, rich tone
-    float full_sine = sine + sine2 + sine3;
-    full_sine *= 0.6f;  // Scale to avoid clipping
-    
-    // Create complex waveforms with softer edges
-    float complex_tone = tri + saw;
-    complex_tone *= 0.6f;  // Scale to avoid clipping
-    
-    // Blend sine-heavy tone with complex tone
-    return full_sine * (1.0f - blend) + complex_tone * blend;
+// Parse "instrument[:semitones[:volume[:output_file]]]" into a job
+int parse_render_spec(const char *spec, RenderJob *job) {
+    char buffer[512];
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    
+    memset(job, 0, sizeof(RenderJob));
+    job->volume = 1.0f;
+    
+    // The output file takes whatever follows the third ':', colons and all
+    char *fields[4] = {buffer, NULL, NULL, NULL};
+    for (int f = 1; f < 4; f++) {
+        char *colon = strchr(fields[f - 1], ':');
+        if (!colon) break;
+        *colon = '\0';
+        fields[f] = colon + 1;
+    }
+    
+    job->instrument = get_instrument_by_name(fields[0]);
+    if (job->instrument < 0) {
+        printf("Error: Unknown instrument in render spec: %s\n", spec);
+        return 1;
+    }
+    if (fields[1] && *fields[1]) job->transpose = atof(fields[1]);
+    if (fields[2] && *fields[2]) job->volume = atof(fields[2]);
+    if (fields[3] && *fields[3]) {
+        strncpy(job->output_file, fields[3], sizeof(job->output_file) - 1);
+    }
+    return 0;
 }
 
-// Bell/FM waveform
-float bell_wave(float x, float harmonics) {
-    float carrier = sinf(x);
-    float modulator = sinf(x * 2.0f) * 5.0f * harmonics;
-    return sinf(x + modulator);
+// Append a job to a growing array
+int add_render_job(RenderJob **jobs, int *num_jobs, int *capacity, const RenderJob *job) {
+    if (*num_jobs == *capacity) {
+        int grown_capacity = *capacity ? *capacity * 2 : 16;
+        RenderJob *grown = (RenderJob*)realloc(*jobs, grown_capacity * sizeof(RenderJob));
+        if (!grown) {
+            printf("Failed to allocate memory\n");
+            return 1;
+        }
+        *jobs = grown;
+        *capacity = grown_capacity;
+    }
+    (*jobs)[(*num_jobs)++] = *job;
+    return 0;
 }
 
-// Add harmonics for organ/brass sounds
-float harmonic_wave(float x, float harmonics) {
-    float result = sinf(x); // Fundamental
-    float amp = 1.0f;
-    
-    // Add odd harmonics (organ-like)
-    for (int h = 3; h <= 9; h += 2) {
-        amp *= 0.5f;
-        result += amp * harmonics * sinf(x * h);
+// Read render specs from a manifest, one per line
+int read_manifest(const char *path, RenderJob **jobs, int *num_jobs, int *capacity) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Error: Could not open manifest %s\n", path);
+        return 1;
     }
     
-    return result / (1.0f + harmonics);
+    char line[512];
+    int failed = 0;
+    while (!failed && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        
+        // Trim surrounding whitespace
+        char *start = line;
+        while (isspace((unsigned char)*start)) start++;
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (*start == '\0') continue;
+        
+        RenderJob job;
+        failed = parse_render_spec(start, &job) || add_render_job(jobs, num_jobs, capacity, &job);
+    }
+    fclose(file);
+    return failed;
 }
 
-// Pluck/string waveform (combines harmonics)
-float pluck_wave(float x, float brightness) {
-    float result = 0.0f;
-    float amp = 1.0f;
+// Render one job's output file from the shared pitch track, a block at a time so
+// memory stays the same however long the input is
+int run_render_job(RenderJob *job, const PitchTrack *track, const RenderOptions *base) {
+    RenderOptions options = *base;
+    options.instrument = job->instrument;
+    options.transpose = job->transpose;
+    options.volume = job->volume;
     
-    // Add harmonics with decay based on brightness
-    for (int h = 1; h <= 12; h++) {
-        float harmonic_amp = amp * expf(-h * (1.0f - brightness));
-        result += harmonic_amp * sinf(x * h);
-        amp *= 0.7f;
-    }
+    printf("Writing output to: %s (Volume: %.2f)\n", job->output_file, job->volume);
     
-    return result * 0.3f; // Scale to avoid clipping
-}
-
-// Acid/303-style waveform with resonant filter emulation
-float acid_wave(float x, float cutoff, float resonance) {
-    // Basic sawtooth as the source
-    float saw = sawtooth_wave(x);
+    SF_INFO outinfo;
+    memset(&outinfo, 0, sizeof(outinfo));
+    outinfo.samplerate = track->samplerate;
+    outinfo.channels = track->channels;
+    outinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
     
-    // Add slight phase-shifted duplicates to simulate resonance
-    float resonant = saw;
-    resonant += 0.4f * resonance * sawtooth_wave(x + 0.05f);
-    resonant += 0.2f * resonance * sawtooth_wave(x - 0.03f);
+    SNDFILE *outfile = sf_open(job->output_file, SFM_WRITE, &outinfo);
+    if (!outfile) {
+        printf("Error opening output file %s: %s\n", job->output_file, sf_strerror(NULL));
+        return 1;
+    }
     
-    // Apply a soft clip to emulate filter distortion
-    if (resonant > 0.8f) resonant = 0.8f + (resonant - 0.8f) * 0.5f;
-    if (resonant < -0.8f) resonant = -0.8f + (resonant + 0.8f) * 0.5f;
+    Renderer renderer;
+    float *block = malloc(STREAM_BLOCK * track->channels * sizeof(float));
+    profile_alloc(PROFILE_ENCODE, STREAM_BLOCK * track->channels * sizeof(float));
+    if (!block || renderer_init(&renderer, track, &options)) {
+        printf("Failed to allocate memory\n");
+        free(block);
+        sf_close(outfile);
+        return 1;
+    }
+    
+    // A short write (full disk, I/O error) fails the job rather than leaving a
+    // truncated file behind a zero exit status
+    int frames;
+    int failed = 0;
+    while (!failed && (frames = renderer_render(&renderer, block, STREAM_BLOCK)) > 0) {
+        int64_t start = profile_begin();
+        failed = sf_writef_float(outfile, block, frames) != frames;
+        profile_end(PROFILE_ENCODE, start);
+    }
+    int64_t start = profile_begin();
+    failed |= sf_close(outfile) != 0;
+    profile_end(PROFILE_ENCODE, start);
+    if (failed) {
+        printf("Error: Could not write to %s\n", job->output_file);
+    }
     
-    return resonant * cutoff; 
+    renderer_free(&renderer);
+    free(block);
+    return failed;
 }
 
-// General purpose instrument waveform selector
-float instrument_wave(float x, int instrument, float wave_blend, float brightness, float harmonics) {
-    float result = 0.0f;
-    
-    switch (instrument) {
-        case INSTR_PAD:
-            return pad_wave(x, wave_blend);
-            
-        case INSTR_PLUCK:
-            return pluck_wave(x, brightness);
-            
-        case INSTR_BRASS:
-        case INSTR_FLUTE:
-            return harmonic_wave(x, harmonics);
-            
-        case INSTR_STRINGS:
-            // Blend of sawtooth and triangle for strings
-            return sawtooth_wave(x) * 0.6f + triangle_wave(x) * 0.4f;
-            
-        case INSTR_ORGAN:
-            // Blend square and harmonics for organ
-            return square_wave(x) * 0.3f + harmonic_wave(x, harmonics) * 0.7f;
-            
-        case INSTR_BELL:
-            return bell_wave(x, harmonics);
-            
-        case INSTR_BASS:
-            // Deep bass sound (blend of sine and square)
-            return sinf(x) * (1.0f - wave_blend) + square_wave(x) * wave_blend * 0.7f;
-            
-        case INSTR_WURLITZER:
-            // Electric piano sound (blend of triangle and bell)
-            return triangle_wave(x) * 0.6f + bell_wave(x, harmonics * 0.3f) * 0.4f;
-            
-        case INSTR_ACID:
-            // Acid bassline with resonant filter effect
-            return acid_wave(x, brightness, wave_blend);
-            
-        default:
-            return sinf(x);
-    }
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-// Convert semitones to frequency multiplier
-float semitones_to_multiplier(float semitones) {
-    return powf(2.0f, semitones / 12.0f);
+void live_signal(int signum) {
+    (void)signum;
+    live_stop = 1;
 }
 
-// ADSR envelope
-float adsr_envelope(float time, float attack, float decay, float sustain, float release, float note_length) {
-    if (time < attack) {
-        return time / attack; // Attack phase
-    } else if (time < attack + decay) {
-        return 1.0f - (1.0f - sustain) * (time - attack) / decay; // Decay phase
-    } else if (time < note_length) {
-        return sustain; // Sustain phase
-    } else if (time < note_length + release) {
-        return sustain * (1.0f - (time - note_length) / release); // Release phase
-    } else {
-        return 0.0f; // Note ended
+// Write all of `bytes`, retrying short writes
+int write_all(int fd, const void *data, size_t bytes) {
+    const char *p = (const char*)data;
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 1;
+        p += n;
+        bytes -= n;
     }
+    return 0;
 }
 
-// Simple reverb implementation
-void apply_reverb(float *buffer, int length, int channels) {
-    float *delay_lines[4];
-    int delay_lengths[4] = {REVERB_DELAY1, REVERB_DELAY2, REVERB_DELAY3, REVERB_DELAY4};
-    int delay_indices[4] = {0, 0, 0, 0};
-    
-    // Allocate delay lines
-    for (int i = 0; i < 4; i++) {
-        delay_lines[i] = (float*)calloc(delay_lengths[i], sizeof(float));
-        if (!delay_lines[i]) {
-            printf("Failed to allocate memory for reverb\n");
-            return;
-        }
+// Stream raw PCM through a live renderer until the input ends (or SIGINT), then
+// report how long frames took to come back out
+int run_live(const char *input_file, const RenderJob *job, const RenderOptions *base,
+             int samplerate, int channels, int format) {
+    RenderOptions options = *base;
+    options.instrument = job->instrument;
+    options.transpose = job->transpose;
+    options.volume = job->volume;
+    
+    const char *output_file = job->output_file[0] ? job->output_file : "-";
+    int in_fd = strcmp(input_file, "-") == 0 ? STDIN_FILENO : open(input_file, O_RDONLY);
+    int out_fd = strcmp(output_file, "-") == 0 ? STDOUT_FILENO :
+                 open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (in_fd < 0 || out_fd < 0) {
+        fprintf(stderr, "Error opening %s\n", in_fd < 0 ? input_file : output_file);
+        return 1;
     }
     
-    // Create a temporary buffer for the dry signal
-    float *dry_buffer = (float*)malloc(length * channels * sizeof(float));
-    if (!dry_buffer) {
-        printf("Failed to allocate memory for reverb\n");
-        return;
+    // Stop cleanly on Ctrl-C (interrupting the read), and on a closed output
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = live_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    LiveRenderer live;
+    if (live_renderer_init(&live, &options, samplerate, channels)) {
+        return 1;
     }
     
-    // Save the dry signal
-    memcpy(dry_buffer, buffer, length * channels * sizeof(float));
+    int frame_bytes = live_format_sizes[format] * channels;
+    char *raw = malloc((size_t)STREAM_BLOCK * frame_bytes);       // Input as read
+    char *raw_out = malloc((size_t)STREAM_BLOCK * frame_bytes);   // Output as written
+    float *in = malloc(sizeof(float) * STREAM_BLOCK * channels);
+    float *out = malloc(sizeof(float) * STREAM_BLOCK * channels);
+    LiveArrival *arrivals = malloc(sizeof(LiveArrival) * LIVE_ARRIVALS);
+    int failed = !raw || !raw_out || !in || !out || !arrivals;
+    if (failed) {
+        fprintf(stderr, "Failed to allocate memory\n");
+    }
     
-    // Process the buffer
-    for (int i = 0; i < length; i++) {
-        // Get the current sample (average of all channels)
-        float input = 0;
-        for (int ch = 0; ch < channels; ch++) {
-            input += buffer[i * channels + ch];
+    fprintf(stderr, "Live: %d Hz, %d channel%s, %s PCM, %s, %s pitch engine\n", samplerate, channels,
+            channels == 1 ? "" : "s", live_format_names[format], instrument_names[job->instrument],
+            options.pitch_engine->name);
+    int latency = live_renderer_latency(&live);
+    fprintf(stderr, "Engine latency: at most %d frames (%.1f ms), plus the input's and output's buffering\n",
+            latency, 1000.0 * latency / samplerate);
+    
+    int first = 0, count = 0;       // Queue of arrivals not yet fully output
+    int pending = 0;                // Bytes of a partial frame left over from the last read
+    long long reads = 0, writes = 0;
+    double latency_total = 0.0, latency_max = 0.0;
+    double busy_total = 0.0, busy_max = 0.0;
+    sf_count_t lag_max = 0;
+    int ended = 0;
+    
+    while (!ended && !failed) {
+        ssize_t got = 0;
+        if (!live_stop) {
+            got = read(in_fd, raw + pending, (size_t)STREAM_BLOCK * frame_bytes - pending);
+            if (got < 0 && errno == EINTR) continue;
+        }
+        double arrived = now_seconds();
+        if (got <= 0) {
+            live_renderer_finish(&live);
+            ended = 1;
         }
-        input /= channels;
         
-        // Calculate the reverb output (feedback delay network)
-        float output = 0;
-        for (int j = 0; j < 4; j++) {
-            // Get output from delay line
-            float delay_out = delay_lines[j][delay_indices[j]];
-            output += delay_out;
-            
-            // Update delay line with input + feedback
-            delay_lines[j][delay_indices[j]] = input * 0.25f + delay_out * g_reverb_decay;
+        int frames = got > 0 ? (int)((pending + got) / frame_bytes) : 0;
+        if (frames > 0) {
+            int64_t start = profile_begin();
+            if (format == LIVE_S16) {
+                const int16_t *s = (const int16_t*)raw;
+                for (int i = 0; i < frames * channels; i++) in[i] = s[i] / 32768.0f;
+            } else {
+                memcpy(in, raw, sizeof(float) * frames * channels);
+            }
+            profile_end(PROFILE_DECODE, start);
+            pending = (int)(pending + got) - frames * frame_bytes;
+            memmove(raw, raw + frames * frame_bytes, pending);
             
-            // Update delay indices
-            delay_indices[j] = (delay_indices[j] + 1) % delay_lengths[j];
+            // Remember when these frames arrived; if too many reads are outstanding,
+            // fold this one into the last (which overstates its latency, never under)
+            if (count == LIVE_ARRIVALS) {
+                arrivals[(first + count - 1) % LIVE_ARRIVALS].end = live.frames_in + frames;
+            } else {
+                arrivals[(first + count) % LIVE_ARRIVALS] = (LiveArrival){live.frames_in + frames, arrived};
+                count++;
+            }
+            reads++;
         }
-        output *= 0.5f;  // Scale the output to prevent clipping
         
-        // Mix dry and wet signals
-        for (int ch = 0; ch < channels; ch++) {
-            buffer[i * channels + ch] = dry_buffer[i * channels + ch] * (1.0f - g_reverb_mix) + 
-                                      output * g_reverb_mix;
-        }
-    }
-    
-    // Clean up
-    free(dry_buffer);
-    for (int i = 0; i < 4; i++) {
-        free(delay_lines[i]);
+        // Alternate feeding input and draining output until this read is used up
+        int fed = 0;
+        do {
+            int taken = fed < frames ? live_renderer_write(&live, in + (sf_count_t)fed * channels, frames - fed) : 0;
+            if (taken < 0) {
+                failed = 1;
+                break;
+            }
+            fed += taken;
+            
+            int rendered;
+            while (!failed && (rendered = live_renderer_read(&live, out, STREAM_BLOCK)) > 0) {
+                int samples = rendered * channels;
+                int64_t start = profile_begin();
+                if (format == LIVE_S16) {
+                    int16_t *s = (int16_t*)raw_out;
+                    for (int i = 0; i < samples; i++) {
+                        float v = out[i] * 32768.0f;
+                        s[i] = v >= 32767.0f ? 32767 : v <= -32768.0f ? -32768 : (int16_t)lrintf(v);
+                    }
+                    failed = write_all(out_fd, s, (size_t)samples * sizeof(int16_t));
+                } else {
+                    failed = write_all(out_fd, out, (size_t)samples * sizeof(float));
+                }
+                profile_end(PROFILE_ENCODE, start);
+                
+                // Time the newest frame written against the same input frame's arrival
+                double written = now_seconds();
+                while (count > 0 && arrivals[first].end < live.frames_out) {
+                    first = (first + 1) % LIVE_ARRIVALS;
+                    count--;
+                }
+                if (count > 0) {
+                    double latency = written - arrivals[first].time;
+                    latency_total += latency;
+                    if (latency > latency_max) latency_max = latency;
+                    writes++;
+                }
+            }
+        } while (!failed && fed < frames);
+        
+        // What the engine still holds back once it has given out all it can
+        sf_count_t lag = live.frames_in - live.frames_out;
+        if (lag > lag_max) lag_max = lag;
+        
+        double busy = now_seconds() - arrived;
+        busy_total += busy;
+        if (busy > busy_max) busy_max = busy;
     }
-}
-
-void fft(float *buffer, int n, float *frequency, float *amplitude) {
-    fftwf_complex *out;
-    fftwf_plan plan;
-    float *in;
-    
-    in = (float*) fftwf_malloc(sizeof(float) * n);
-    out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * (n/2 + 1));
     
-    for (int i = 0; i < n; i++) {
-        in[i] = buffer[i];
+    double seconds = (double)live.frames_in / samplerate;
+    fprintf(stderr, "Processed %lld frames (%.1f s) in %lld reads%s\n", (long long)live.frames_in,
+            seconds, reads, failed ? ", stopped early" : "");
+    fprintf(stderr, "Held back by the engine after each read: at most %lld frames (%.1f ms)\n",
+            (long long)lag_max, 1000.0 * lag_max / samplerate);
+    if (writes > 0) {
+        fprintf(stderr, "Latency, input frame read to output frame written: mean %.1f ms, max %.1f ms\n",
+                1000.0 * latency_total / writes, 1000.0 * latency_max);
     }
-    
-    plan = fftwf_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
-    fftwf_execute(plan);
-    
-    float max_amplitude = 0;
-    int max_bin = 0;
-    
-    for (int i = 0; i < n/2 + 1; i++) {
-        float amp = sqrtf(out[i][0] * out[i][0] + out[i][1] * out[i][1]);
-        if (amp > max_amplitude) {
-            max_amplitude = amp;
-            max_bin = i;
-        }
+    if (reads > 0 && seconds > 0.0) {
+        fprintf(stderr, "Processing and writing: mean %.2f ms, max %.2f ms per read (%.1f%% of real time)\n",
+                1000.0 * busy_total / reads, 1000.0 * busy_max, 100.0 * busy_total / seconds);
     }
     
-    *frequency = (float)max_bin * 44100 / n;
-    *amplitude = max_amplitude;
-    
-    fftwf_destroy_plan(plan);
-    fftwf_free(in);
-    fftwf_free(out);
+    live_renderer_free(&live);
+    free(raw);
+    free(raw_out);
+    free(in);
+    free(out);
+    free(arrivals);
+    if (in_fd != STDIN_FILENO) close(in_fd);
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    return failed;
 }
 
-void print_usage(const char* program_name) {
-    printf("Usage: %s <input_wav_file> [semitones] [instrument] [volume] [output_file]\n", program_name);
-    printf("  input_wav_file: Path to the source WAV file\n");
-    printf("  semitones: Transposition amount in semitones (positive or negative)\n");
-    printf("             Default: 0 (no transposition)\n");
-    printf("  instrument: Instrument type (0-9 or name)\n");
-    printf("             0/pad:        Lush Pad\n");
-    printf("             1/pluck:      Plucked String\n");
-    printf("             2/brass:      Brass\n");
-    printf("             3/flute:      Flute\n");
-    printf("             4/strings:    Strings\n");
-    printf("             5/organ:      Organ\n");
-    printf("             6/bell:       Bell\n");
-    printf("             7/bass:       Bass\n");
-    printf("             8/wurlitzer:  Wurlitzer\n");
-    printf("             9/acid:       Acid\n");
-    printf("             Default: 0 (Pad)\n");
-    printf("  volume: Output volume multiplier (0.0-10.0) (optional)\n");
-    printf("             Default: 1.0 (original volume)\n");
-    printf("  output_file: Path to the output WAV file (optional)\n");
-    printf("             Default: <input_basename>_<instrument>_<semitones>.wav\n");
+// Write the --profile report and trace, if asked for, with messages to `messages`
+// (stderr when stdout is live audio). Returns 1 if they couldn't be written.
+int write_profile(const char *profile_file, const char *trace_file, FILE *messages) {
+    if (!profile_file) return 0;
+    int failed = profile_write(profile_file, trace_file);
+    if (failed) {
+        fprintf(messages, "Error: Could not write the profile to %s\n", profile_file);
+    } else {
+        fprintf(messages, "Wrote profile to %s%s%s\n", profile_file, trace_file ? " and trace to " : "",
+                trace_file ? trace_file : "");
+    }
+    profile_free();
+    return failed;
 }
 
-// Create a function to get instrument index by name
-int get_instrument_by_name(const char *name) {
-    const char *names[] = {
-        "pad", "pluck", "brass", "flute", "strings", 
-        "organ", "bell", "bass", "wurlitzer", "acid"
-    };
-    
-    // Also accept full names with case insensitivity
-    const char *full_names[] = {
-        "lush pad", "plucked string", "brass", "flute", "strings", 
-        "organ", "bell", "bass", "wurlitzer", "acid"
-    };
-    
-    for (int i = 0; i < 10; i++) {
-        if (STR_COMPARE(name, names[i]) == 0 || STR_COMPARE(name, full_names[i]) == 0) {
-            return i;
-        }
-    }
-    
-    // Not found - try to convert to a number
-    char *endptr;
-    int idx = (int)strtol(name, &endptr, 10);
-    
-    // If conversion successful and in range, return it
-    if (*name != '\0' && *endptr == '\0' && idx >= 0 && idx <= 9) {
-        return idx;
+// Worker thread: keep taking the next job until there are none left
+void *render_worker(void *arg) {
+    RenderQueue *queue = (RenderQueue*)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->num_jobs) break;
+        
+        profile_set_track(i);
+        queue->jobs[i].failed = run_render_job(&queue->jobs[i], queue->track, queue->options);
     }
-    
-    // Invalid instrument
-    return -1;
+    return NULL;
 }
 
 int main(int argc, char *argv[]) {
-    // Parse command line arguments
-    if (argc < 2) {
-        print_usage(argv[0]);
-        return 1;
-    }
-    
-    const char *input_file = argv[1];
-    float transpose_semitones = 0.0f;
-    int instrument = INSTR_PAD;  // Default to pad
-    float volume_multiplier = 1.0f;  // Default volume multiplier
-    const char *custom_output_file = NULL;
-    
-    if (argc >= 3) {
-        transpose_semitones = atof(argv[2]);
-    }
-    
-    if (argc >= 4) {
-        // Check if it's a name or number
-        if (isdigit(argv[3][0]) || (argv[3][0] == '-' && isdigit(argv[3][1]))) {
-            instrument = atoi(argv[3]);
-            // Validate instrument range
-            if (instrument < 0 || instrument > 9) {
-                printf("Error: Instrument must be between 0 and 9\n");
+    // Pull out --options first so the positional arguments keep their places
+    RenderOptions options;
+    render_options_init(&options);
+    const char *simd = "auto";           // Oscillator bank kernel
+    int analysis_only = 0;               // Just write the pitch track sidecar
+    int live = 0;                        // Stream raw PCM instead of reading a file
+    int live_rate = 44100;
+    int live_channels = 1;
+    int live_format = LIVE_S16;
+    const char *profile_file = NULL;     // --profile report
+    const char *trace_file = NULL;       // --profile-trace Chrome trace
+    RenderJob *jobs = NULL;              // Outputs from --render/--manifest
+    int num_jobs = 0;
+    int jobs_capacity = 0;
+    int positional = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--wisdom") == 0 && i + 1 < argc) {
+            options.wisdom_file = argv[++i];
+        } else if (strcmp(argv[i], "--control-block") == 0 && i + 1 < argc) {
+            options.control_block = atoi(argv[++i]);
+            if (options.control_block < 1) {
+                printf("Error: --control-block must be at least 1\n");
                 print_usage(argv[0]);
                 return 1;
             }
-        } else {
-            // Try to get instrument by name
-            instrument = get_instrument_by_name(argv[3]);
-            if (instrument < 0) {
-                printf("Error: Unknown instrument name: %s\n", argv[3]);
+        } else if (strcmp(argv[i], "--analysis-only") == 0) {
+            analysis_only = 1;
+        } else if (strcmp(argv[i], "--no-pitch-cache") == 0) {
+            options.pitch_cache = 0;
+        } else if (strcmp(argv[i], "--adaptive-hop") == 0) {
+            options.adaptive_hop = 1;
+        } else if (strcmp(argv[i], "--per-channel") == 0) {
+            options.per_channel = 1;
+        } else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            RenderJob job;
+            if (parse_render_spec(argv[++i], &job) || add_render_job(&jobs, &num_jobs, &jobs_capacity, &job)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            if (read_manifest(argv[++i], &jobs, &num_jobs, &jobs_capacity)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pitch-engine") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            options.pitch_engine = pitch_engine_find(name);
+            if (!options.pitch_engine) {
+                printf("Error: Unknown pitch engine: %s\n", name);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--live") == 0) {
+            live = 1;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            live_rate = atoi(argv[++i]);
+            if (live_rate < 1) {
+                printf("Error: --rate must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+            live_channels = atoi(argv[++i]);
+            if (live_channels < 1) {
+                printf("Error: --channels must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sample-format") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            live_format = -1;
+            for (int f = 0; f < 2; f++) {
+                if (STR_COMPARE(name, live_format_names[f]) == 0) live_format = f;
+            }
+            if (live_format < 0) {
+                printf("Error: Unknown sample format: %s\n", name);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            simd = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+            if (options.threads < 1) {
+                printf("Error: --threads must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fft-planner") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            int found = 0;
+            for (int p = 0; p < 3; p++) {
+                if (STR_COMPARE(name, planner_names[p]) == 0) {
+                    options.fft_planner = planner_flags[p];
+                    found = 1;
+                }
+            }
+            if (!found) {
+                printf("Error: Unknown FFT planner: %s\n", name);
                 print_usage(argv[0]);
                 return 1;
             }
+        } else {
+            argv[positional++] = argv[i];
         }
     }
+    argc = positional;
     
-    if (argc >= 5) {
-        volume_multiplier = atof(argv[4]);
-        // Validate volume range (allow some headroom but prevent extreme values)
-        if (volume_multiplier < 0.0f || volume_multiplier > 10.0f) {
-            printf("Warning: Volume should be between 0.0 and 10.0. Using volume = %.1f\n", volume_multiplier);
-        }
+    // Parse command line arguments
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
     }
     
-    if (argc >= 6) {
-        custom_output_file = argv[5];
-    }
+    const char *input_file = argv[1];
     
-    // Get the preset for the selected instrument
-    const InstrumentPreset* preset = &presets[instrument];
-
-    // Calculate frequency multiplier from semitones
-    float freq_multiplier = semitones_to_multiplier(transpose_semitones);
-    printf("Transposing by %.1f semitones (multiplier: %.3f)\n", transpose_semitones, freq_multiplier);
-
-    // Get instrument name
-    const char *instrument_names[] = {
-        "Lush Pad", "Plucked String", "Brass", "Flute", "Strings", 
-        "Organ", "Bell", "Bass", "Wurlitzer", "Acid"
-    };
-    printf("Using instrument: %d - %s\n", instrument, instrument_names[instrument]);
-    
-    SF_INFO sfinfo;
-    sfinfo.format = 0;
-    
-    SNDFILE *infile = sf_open(input_file, SFM_READ, &sfinfo);
-    if (!infile) {
-        printf("Error opening input file: %s\n", sf_strerror(NULL));
+    if (trace_file && !profile_file) {
+        printf("Error: --profile-trace needs --profile\n");
+        print_usage(argv[0]);
         return 1;
     }
     
-    printf("Processing file: %s\n", input_file);
-    printf("Sample rate: %d Hz, Channels: %d, Frames: %lld\n", 
-           sfinfo.samplerate, sfinfo.channels, sfinfo.frames);
-
-    // Allocate buffers
-    sf_count_t items = sfinfo.frames * sfinfo.channels;
-    float *buffer = malloc(items * sizeof(float));
-    float *chorus_buffer = malloc(items * sizeof(float));
-    float *window_buffer = malloc(WINDOW_SIZE * sizeof(float));
-    FrequencyPoint *freq_data = malloc(((sfinfo.frames - WINDOW_SIZE) / HOP_SIZE + 1) * sizeof(FrequencyPoint));
-    
-    if (!buffer || !window_buffer || !freq_data || !chorus_buffer) {
-        printf("Failed to allocate memory\n");
+    if (live && (analysis_only || num_jobs > 0)) {
+        printf("Error: --live renders the one output given after the input, without --render or --analysis-only\n");
+        print_usage(argv[0]);
         return 1;
     }
     
-    // Clear buffers
-    memset(buffer, 0, items * sizeof(float));
-    memset(chorus_buffer, 0, items * sizeof(float));
+    if (live && options.adaptive_hop) {
+        printf("Error: --live analyses every window as it arrives, so it can't be used with --adaptive-hop\n");
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    // Read input file
-    sf_readf_float(infile, buffer, sfinfo.frames);
-    sf_close(infile);
+    if (live && options.per_channel) {
+        printf("Error: --live tracks channel 0 only, so it can't be used with --per-channel\n");
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    // Analyze audio
-    int num_windows = (sfinfo.frames - WINDOW_SIZE) / HOP_SIZE + 1;
+    // Each output is a track of the profile (without --render there's just the one)
+    int profile_tracks = analysis_only ? 0 : num_jobs > 0 ? num_jobs : 1;
+    if (profile_file && profile_init("whistler", profile_tracks, trace_file != NULL)) {
+        printf("Failed to allocate memory\n");
+        return 1;
+    }
     
-    float last_valid_frequency = 0.0f;
-    for (int w = 0; w < num_windows; w++) {
-        // Fill window buffer
-        for (int i = 0; i < WINDOW_SIZE; i++) {
-            window_buffer[i] = buffer[w * HOP_SIZE * sfinfo.channels + i * sfinfo.channels];
-        }
-        
-        // Apply Hann window
-        for (int i = 0; i < WINDOW_SIZE; i++) {
-            float hann = 0.5 * (1 - cosf(2 * M_PI * i / (WINDOW_SIZE - 1)));
-            window_buffer[i] *= hann;
+    // Only the pitch track is wanted: analyse (or check the sidecar is current) and stop
+    if (analysis_only) {
+        if (!options.pitch_cache) {
+            printf("Error: --analysis-only writes the pitch track sidecar, so it can't be used with --no-pitch-cache\n");
+            return 1;
         }
-        
-        // Perform FFT
-        float frequency, amplitude;
-        fft(window_buffer, WINDOW_SIZE, &frequency, &amplitude);
-
-        // Only update frequency if amplitude is above threshold and frequency is in range
-        if (amplitude > AMP_THRESHOLD && 
-            frequency >= MIN_FREQUENCY && frequency <= MAX_FREQUENCY) {
-            last_valid_frequency = frequency;
-            // Apply transposition to the detected frequency
-            freq_data[w].frequency = frequency;
-        } else {
-            freq_data[w].frequency = last_valid_frequency;
+        PitchTrack track;
+        if (pitch_track_analyze(input_file, &options, &track)) {
+            return 1;
         }
-        freq_data[w].amplitude = amplitude / AMP_SCALE;
-    }
-    
-    // Generate output
-    memset(buffer, 0, items * sizeof(float));
-    float phase[NUM_OSCILLATORS] = {0};  // Phase for each oscillator
-    float chorus_phase = 0.0f;           // Phase for chorus LFO
-    float filter_phase = 0.0f;           // Phase for filter modulation
-    float tremolo_phase = 0.0f;          // Phase for tremolo
-    float current_frequency = freq_data[0].frequency;
-    float smooth_amp = 0.0f;  // Start with zero amplitude
-    
-    // Get preset values for more readable code
-    int num_oscillators = preset->num_oscillators;
-    float detune_amount = preset->detune_amount;
-    float attack_time = preset->attack_time;
-    float decay_time = preset->decay_time;
-    float sustain_level = preset->sustain_level;
-    float release_time = preset->release_time;
-    float octave_mix = preset->octave_mix;
-    float chorus_rate = preset->chorus_rate;
-    float chorus_depth = preset->chorus_depth;
-    float chorus_mix = preset->chorus_mix;
-    float reverb_mix = preset->reverb_mix;
-    float wave_blend = preset->wave_blend;
-    float brightness = preset->brightness;
-    float harmonics = preset->harmonics;
-    float tremolo_rate = preset->tremolo_rate;
-    float tremolo_depth = preset->tremolo_depth;
-    float filter_mod = preset->filter_mod;
-    
-    for (int w = 0; w < num_windows; w++) {
-        int start_frame = w * HOP_SIZE;
-        int end_frame = (w == num_windows - 1) ? sfinfo.frames : (w + 1) * HOP_SIZE;
+        pitch_track_free(&track);
+        return write_profile(profile_file, trace_file, stdout);
+    }
+    
+    if (num_jobs > 0 && argc > 2) {
+        printf("Error: Give the outputs either with --render/--manifest or after the input file, not both\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    // Without --render, the positional arguments describe the one output
+    if (num_jobs == 0) {
+        RenderJob job;
+        memset(&job, 0, sizeof(RenderJob));
+        job.instrument = INSTR_PAD;  // Default to pad
+        job.volume = 1.0f;  // Default volume multiplier
         
-        // Keep current frequency if amplitude is below threshold
-        float next_frequency = current_frequency;
-        if (freq_data[w].amplitude > AMP_THRESHOLD && w < num_windows - 1) {
-            next_frequency = freq_data[w + 1].frequency;
+        if (argc >= 3) {
+            job.transpose = atof(argv[2]);
         }
         
-        for (int i = 0; i < end_frame - start_frame; i++) {
-            int current_sample = start_frame + i;
-            float progress = (float)i / (end_frame - start_frame);
-            float frequency = current_frequency * (1.0f - progress) + next_frequency * progress;
-            
-            // Apply frequency multiplier (transposition)
-            float transposed_freq = frequency * freq_multiplier;
-            
-            // Smooth amplitude transitions
-            smooth_amp = smooth_amp * (1.0f - AMP_SMOOTH) + freq_data[w].amplitude * AMP_SMOOTH;
-            
-            // Calculate envelope
-            float env_time = (float)current_sample / sfinfo.samplerate;
-            float note_length = (float)sfinfo.frames / sfinfo.samplerate;
-
-            // Ensure release phase starts at an appropriate time, especially for long release times
-            float release_start = note_length - release_time * 1.5f;
-            if (release_start < attack_time + decay_time) {
-                // If the file is very short, adjust to ensure we still hear something
-                release_start = attack_time + decay_time + 0.1f;
-            }
-
-            float envelope = adsr_envelope(env_time, attack_time, decay_time, sustain_level, release_time, release_start);
-            
-            // Update chorus LFO
-            float chorus_lfo_rate = 2.0f * M_PI * chorus_rate / sfinfo.samplerate;
-            chorus_phase += chorus_lfo_rate;
-            if (chorus_phase >= 2.0f * M_PI) chorus_phase -= 2.0f * M_PI;
-            float chorus_mod = chorus_depth * sinf(chorus_phase);
-            
-            // Update filter modulation
-            float filter_lfo_rate = 2.0f * M_PI * 0.1f / sfinfo.samplerate;  // 0.1 Hz filter sweep
-            filter_phase += filter_lfo_rate;
-            if (filter_phase >= 2.0f * M_PI) filter_phase -= 2.0f * M_PI;
-            float filter_mod_amount = 0.5f + 0.5f * sinf(filter_phase) * filter_mod;
-            
-            // Update tremolo if used
-            float tremolo_amount = 1.0f;
-            if (tremolo_rate > 0.0f) {
-                float tremolo_lfo_rate = 2.0f * M_PI * tremolo_rate / sfinfo.samplerate;
-                tremolo_phase += tremolo_lfo_rate;
-                if (tremolo_phase >= 2.0f * M_PI) tremolo_phase -= 2.0f * M_PI;
-                tremolo_amount = 1.0f - tremolo_depth * (0.5f + 0.5f * sinf(tremolo_phase));
-            }
-            
-            // Generate multi-oscillator sound
-            float sample = 0.0f;
-            for (int osc = 0; osc < num_oscillators; osc++) {
-                // Calculate detune factor based on oscillator index
-                float detune_factor = 1.0f;
-                if (osc == 0) {
-                    detune_factor = 1.0f;  // Root note
-                } else if (osc == 1 && num_oscillators > 1) {
-                    detune_factor = semitones_to_multiplier(detune_amount);  // Slightly sharp
-                } else if (osc == 2 && num_oscillators > 2) {
-                    detune_factor = semitones_to_multiplier(-detune_amount); // Slightly flat
-                } else if (osc == 3 && num_oscillators > 3) {
-                    detune_factor = 0.5f;  // Octave below
+        if (argc >= 4) {
+            // Check if it's a name or number
+            if (isdigit(argv[3][0]) || (argv[3][0] == '-' && isdigit(argv[3][1]))) {
+                job.instrument = atoi(argv[3]);
+                // Validate instrument range
+                if (job.instrument < 0 || job.instrument > 9) {
+                    printf("Error: Instrument must be between 0 and 9\n");
+                    print_usage(argv[0]);
+                    return 1;
                 }
-                
-                // Update phase for this oscillator
-                float phase_increment = 2.0f * M_PI * (transposed_freq * detune_factor) / sfinfo.samplerate;
-                phase[osc] += phase_increment;
-                while (phase[osc] >= 2.0f * M_PI) phase[osc] -= 2.0f * M_PI;
-                
-                // Generate waveform based on instrument type
-                float osc_sample = instrument_wave(phase[osc], instrument, 
-                                                   wave_blend, 
-                                                   brightness * filter_mod_amount,
-                                                   harmonics);
-                
-                // Apply oscillator mixing (lower volume for sub-oscillator)
-                float osc_mix = (osc == 3) ? octave_mix : (1.0f - octave_mix) / (num_oscillators - 1);
-                sample += osc_sample * osc_mix;
-            }
-            
-            // Apply envelope, amplitude and tremolo
-            sample *= smooth_amp * envelope * MASTER_VOLUME * tremolo_amount;
-            
-            // Store in main buffer
-            for (int ch = 0; ch < sfinfo.channels; ch++) {
-                buffer[current_sample * sfinfo.channels + ch] = sample;
-            }
-            
-            // Create delayed chorus signal (if used)
-            if (chorus_mix > 0.0f) {
-                float chorus_delay_secs = 0.02f + 0.01f * chorus_mod; // 20-30ms delay
-                int chorus_delay_samples = (int)(chorus_delay_secs * sfinfo.samplerate);
-                
-                // Only store the chorus signal if we have enough delay space
-                if (current_sample + chorus_delay_samples < sfinfo.frames) {
-                    for (int ch = 0; ch < sfinfo.channels; ch++) {
-                        chorus_buffer[(current_sample + chorus_delay_samples) * sfinfo.channels + ch] += 
-                            sample * chorus_mix;
-                    }
+            } else {
+                // Try to get instrument by name
+                job.instrument = get_instrument_by_name(argv[3]);
+                if (job.instrument < 0) {
+                    printf("Error: Unknown instrument name: %s\n", argv[3]);
+                    print_usage(argv[0]);
+                    return 1;
                 }
             }
         }
         
-        current_frequency = next_frequency;
+        if (argc >= 5) {
+            job.volume = atof(argv[4]);
+        }
+        
+        if (argc >= 6) {
+            strncpy(job.output_file, argv[5], sizeof(job.output_file) - 1);
+        }
+        
+        if (add_render_job(&jobs, &num_jobs, &jobs_capacity, &job)) {
+            return 1;
+        }
     }
     
-    // Mix chorus buffer into main buffer
-    for (int i = 0; i < items; i++) {
-        buffer[i] = buffer[i] * (1.0f - chorus_mix) + chorus_buffer[i];
+    options.kernel = osc_bank_select(simd);
+    if (!options.kernel) {
+        printf("Error: SIMD kernel '%s' is not available on this machine\n", simd);
+        print_usage(argv[0]);
+        free(jobs);
+        return 1;
     }
     
-    // Apply reverb to thicken the sound (using preset's reverb_mix)
-    // Temporarily override the REVERB_MIX with the preset value
-    float orig_reverb_mix = g_reverb_mix;
-    g_reverb_mix = reverb_mix;  // This is a bit of a hack but avoids changing the function signature
-    apply_reverb(buffer, sfinfo.frames, sfinfo.channels);
-    g_reverb_mix = orig_reverb_mix;  // Restore the original value
-    
-    // After applying reverb and before saving, apply the volume multiplier
-    for (int i = 0; i < items; i++) {
-        buffer[i] *= volume_multiplier;
+    // Live: stdout may be the audio, so nothing more is printed there
+    if (live) {
+        profile_set_track_name(0, jobs[0].output_file[0] ? jobs[0].output_file : "-");
+        profile_set_track(0);
+        int failed = run_live(input_file, &jobs[0], &options, live_rate, live_channels, live_format);
+        failed |= write_profile(profile_file, trace_file, stderr);
+        free(jobs);
+        return failed;
     }
     
-    // Save output
-    SF_INFO outinfo = sfinfo;
-    outinfo.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
-    
-    // Create output filename based on input, instrument, and transposition
-    char output_file[256];
-    
-    if (custom_output_file) {
-        strncpy(output_file, custom_output_file, sizeof(output_file) - 1);
-        output_file[sizeof(output_file) - 1] = '\0'; // Ensure null termination
-    } else {
-        char *input_name = strdup(input_file);
-        char *extension = strrchr(input_name, '.');
-        if (extension) *extension = '\0';  // Remove extension
+    for (int j = 0; j < num_jobs; j++) {
+        RenderJob *job = &jobs[j];
         
-        const char *basename = strrchr(input_name, '/');
-        basename = basename ? basename + 1 : input_name;  // Get filename without path
+        // Validate volume range (allow some headroom but prevent extreme values)
+        if (job->volume < 0.0f || job->volume > 10.0f) {
+            printf("Warning: Volume should be between 0.0 and 10.0. Using volume = %.1f\n", job->volume);
+        }
         
-        // Get instrument name
-        const char *instrument_names[] = {
-            "pad", "pluck", "brass", "flute", "strings", 
-            "organ", "bell", "bass", "wurlitzer", "acid"
-        };
+        // Create output filename based on input, instrument, and transposition
+        if (job->output_file[0] == '\0') {
+            char *input_name = strdup(input_file);
+            char *extension = strrchr(input_name, '.');
+            if (extension) *extension = '\0';  // Remove extension
+            
+            const char *basename = strrchr(input_name, '/');
+            basename = basename ? basename + 1 : input_name;  // Get filename without path
+            
+            snprintf(job->output_file, sizeof(job->output_file), "%s_%s_%.1f.wav", 
+                    basename, instrument_short_names[job->instrument], job->transpose);
+            free(input_name);
+        }
         
-        snprintf(output_file, sizeof(output_file), "%s_%s_%.1f.wav", 
-                basename, instrument_names[instrument], transpose_semitones);
-        free(input_name);
+        printf("Transposing by %.1f semitones (multiplier: %.3f)\n", job->transpose,
+               semitones_to_multiplier(job->transpose));
+        printf("Using instrument: %d - %s\n", job->instrument, instrument_names[job->instrument]);
+        profile_set_track_name(j, job->output_file);
     }
     
-    printf("Writing output to: %s (Volume: %.2f)\n", output_file, volume_multiplier);
-    
-    SNDFILE *outfile = sf_open(output_file, SFM_WRITE, &outinfo);
-    if (!outfile) {
-        printf("Error opening output file: %s\n", sf_strerror(NULL));
-        free(buffer);
-        free(window_buffer);
-        free(freq_data);
-        free(chorus_buffer);
+    // Analyse once, whatever the number of outputs
+    PitchTrack track;
+    if (pitch_track_analyze(input_file, &options, &track)) {
+        free(jobs);
         return 1;
     }
     
-    sf_writef_float(outfile, buffer, sfinfo.frames);
-    sf_close(outfile);
+    // Render the outputs, several at once if there are cores for it
+    RenderQueue queue;
+    queue.jobs = jobs;
+    queue.num_jobs = num_jobs;
+    queue.next = 0;
+    queue.track = &track;
+    queue.options = &options;
+    pthread_mutex_init(&queue.lock, NULL);
+    
+    int num_threads = options.threads < num_jobs ? options.threads : num_jobs;
+    pthread_t threads[num_threads];
+    int started = 0;
+    for (int t = 1; t < num_threads; t++) {
+        if (pthread_create(&threads[started], NULL, render_worker, &queue) == 0) {
+            started++;
+        }
+    }
+    render_worker(&queue);  // This thread takes jobs too
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    
+    int failed = 0;
+    for (int j = 0; j < num_jobs; j++) {
+        failed |= jobs[j].failed;
+    }
     
     // Cleanup
-    free(buffer);
-    free(window_buffer);
-    free(freq_data);
-    free(chorus_buffer);
-    return 0;
+    pitch_track_free(&track);
+    free(jobs);
+    failed |= write_profile(profile_file, trace_file, stdout);
+    return failed;
 }
-
-// Instrument presets
-const InstrumentPreset presets[] = {
-    // INSTR_PAD (0) - Lush pad sound
-    {
-        .num_oscillators = 4,
-        .detune_amount = 0.12f,        // Increased detune for wider sound
-        .attack_time = 0.8f,           // Much longer attack for slow fade-in
-        .decay_time = 0.5f,            // Longer decay
-        .sustain_level = 0.7f,         // Slightly lower sustain for warmth
-        .release_time = 1.2f,          // Much longer release for slow fade-out
-        .octave_mix = 0.4f,            // More sub-octave for fullness
-        .chorus_rate = 0.12f,          // Slower chorus for smoother movement
-        .chorus_depth = 0.6f,          // Deeper chorus for more richness
-        .chorus_mix = 0.5f,            // More chorus for fuller sound
-        .reverb_mix = 0.6f,            // More reverb for spaciousness
-        .wave_blend = 0.25f,           // More sine content for roundness
-        .brightness = 0.5f,            // Lower brightness to reduce harshness
-        .harmonics = 0.3f,             // Fewer harmonics for smoothness
-        .tremolo_rate = 0.7f,          // Slow tremolo for gentle undulation
-        .tremolo_depth = 0.08f,        // Subtle tremolo depth
-        .filter_mod = 0.2f             // Gentle filter modulation
-    },
-    
-    // INSTR_PLUCK (1) - Plucked string sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.01f,
-        .attack_time = 0.01f,
-        .decay_time = 0.3f,
-        .sustain_level = 0.2f,
-        .release_time = 0.1f,
-        .octave_mix = 0.1f,
-        .chorus_rate = 0.5f,
-        .chorus_depth = 0.2f,
-        .chorus_mix = 0.2f,
-        .reverb_mix = 0.3f,
-        .wave_blend = 0.7f,
-        .brightness = 0.8f,
-        .harmonics = 0.7f,
-        .tremolo_rate = 0.0f,
-        .tremolo_depth = 0.0f,
-        .filter_mod = 0.3f
-    },
-    
-    // INSTR_BRASS (2) - Brass sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.05f,
-        .attack_time = 0.1f,
-        .decay_time = 0.1f,
-        .sustain_level = 0.8f,
-        .release_time = 0.2f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.1f,
-        .chorus_depth = 0.2f,
-        .chorus_mix = 0.1f,
-        .reverb_mix = 0.2f,
-        .wave_blend = 0.8f,
-        .brightness = 0.7f,
-        .harmonics = 0.8f,
-        .tremolo_rate = 0.0f,
-        .tremolo_depth = 0.0f,
-        .filter_mod = 0.2f
-    },
-    
-    // INSTR_FLUTE (3) - Flute/wind sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.03f,
-        .attack_time = 0.15f,
-        .decay_time = 0.1f,
-        .sustain_level = 0.7f,
-        .release_time = 0.15f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.3f,
-        .chorus_depth = 0.3f,
-        .chorus_mix = 0.2f,
-        .reverb_mix = 0.3f,
-        .wave_blend = 0.2f,
-        .brightness = 0.5f,
-        .harmonics = 0.3f,
-        .tremolo_rate = 5.0f,
-        .tremolo_depth = 0.1f,
-        .filter_mod = 0.1f
-    },
-    
-    // INSTR_STRINGS (4) - String section
-    {
-        .num_oscillators = 3,
-        .detune_amount = 0.1f,
-        .attack_time = 0.2f,
-        .decay_time = 0.1f,
-        .sustain_level = 0.7f,
-        .release_time = 0.3f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.3f,
-        .chorus_depth = 0.6f,
-        .chorus_mix = 0.4f,
-        .reverb_mix = 0.5f,
-        .wave_blend = 0.6f,
-        .brightness = 0.6f,
-        .harmonics = 0.5f,
-        .tremolo_rate = 5.5f,
-        .tremolo_depth = 0.2f,
-        .filter_mod = 0.0f
-    },
-    
-    // INSTR_ORGAN (5) - Hammond-like organ
-    {
-        .num_oscillators = 3,
-        .detune_amount = 0.0f,
-        .attack_time = 0.01f,
-        .decay_time = 0.0f,
-        .sustain_level = 1.0f,
-        .release_time = 0.05f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 6.0f,
-        .chorus_depth = 0.3f,
-        .chorus_mix = 0.2f,
-        .reverb_mix = 0.3f,
-        .wave_blend = 0.9f,
-        .brightness = 0.8f,
-        .harmonics = 0.9f,
-        .tremolo_rate = 6.0f,
-        .tremolo_depth = 0.15f,
-        .filter_mod = 0.0f
-    },
-    
-    // INSTR_BELL (6) - Bell/chime sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.01f,
-        .attack_time = 0.01f,
-        .decay_time = 0.5f,
-        .sustain_level = 0.1f,
-        .release_time = 0.8f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.0f,
-        .chorus_depth = 0.0f,
-        .chorus_mix = 0.0f,
-        .reverb_mix = 0.6f,
-        .wave_blend = 0.8f,
-        .brightness = 0.9f,
-        .harmonics = 0.7f,
-        .tremolo_rate = 0.0f,
-        .tremolo_depth = 0.0f,
-        .filter_mod = 0.0f
-    },
-    
-    // INSTR_BASS (7) - Deep bass sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.02f,
-        .attack_time = 0.02f,
-        .decay_time = 0.1f,
-        .sustain_level = 0.8f,
-        .release_time = 0.1f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.0f,
-        .chorus_depth = 0.0f,
-        .chorus_mix = 0.0f,
-        .reverb_mix = 0.1f,
-        .wave_blend = 0.5f,
-        .brightness = 0.4f,
-        .harmonics = 0.3f,
-        .tremolo_rate = 0.0f,
-        .tremolo_depth = 0.0f,
-        .filter_mod = 0.5f
-    },
-    
-    // INSTR_WURLITZER (8) - Electric piano sound
-    {
-        .num_oscillators = 2,
-        .detune_amount = 0.0f,
-        .attack_time = 0.01f,
-        .decay_time = 0.4f,
-        .sustain_level = 0.3f,
-        .release_time = 0.2f,
-        .octave_mix = 0.0f,
-        .chorus_rate = 0.5f,
-        .chorus_depth = 0.2f,
-        .chorus_mix = 0.2f,
-        .reverb_mix = 0.3f,
-        .wave_blend = 0.6f,
-        .brightness = 0.7f,
-        .harmonics = 0.5f,
-        .tremolo_rate = 4.0f,
-        .tremolo_depth = 0.1f,
-        .filter_mod = 0.2f
-    },
-    
-    // INSTR_ACID (9) - Acid/303-style sound
-    {
-        .num_oscillators = 2,         // Use 2 oscillators for more body
-        .detune_amount = 0.01f,       // Very slight detune for thickness
-        .attack_time = 0.01f,         // Fast attack
-        .decay_time = 0.3f,
-        .sustain_level = 0.7f,        // Higher sustain for more presence
-        .release_time = 0.1f,         // Quick release
-        .octave_mix = 0.0f,           // No sub-oscillator
-        .chorus_rate = 0.0f,
-        .chorus_depth = 0.0f,
-        .chorus_mix = 0.0f,           // No chorus
-        .reverb_mix = 0.15f,          // Just a touch of reverb
-        .wave_blend = 0.7f,           // Higher value = more resonance
-        .brightness = 0.9f,           // Very bright filter cutoff
-        .harmonics = 0.0f,
-        .tremolo_rate = 0.0f,
-        .tremolo_depth = 0.0f,
-        .filter_mod = 0.9f            // Strong filter modulation
-    }
-};
\ No newline at end of file
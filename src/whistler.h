@@ -0,0 +1,683 @@
+// whistler.h - the whistler engine: pitch analysis, synthesis and effects on
+// in-memory buffers. Used by the whistler and chorus command line tools.
+#ifndef WHISTLER_H
+#define WHISTLER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sndfile.h>
+#include <fftw3.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// Use the right string comparison function for the platform
+#if defined(_WIN32) || defined(_WIN64)
+    #define STR_COMPARE _stricmp
+#else
+    #include <strings.h>
+    #define STR_COMPARE strcasecmp
+#endif
+
+// Bump whenever a change alters rendered output, so cached renders made by an
+// older engine are never reused
+#define WHISTLER_ENGINE_VERSION 5
+
+// Core settings
+#define MASTER_VOLUME 0.8f
+#define MIN_FREQUENCY 200.0f
+#define MAX_FREQUENCY 1500.0f
+#define WINDOW_SIZE 1024
+#define HOP_SIZE 128
+#define ANALYSIS_BATCH 64    // Hop windows transformed per batched FFT execution
+#define ANALYSIS_CHUNK_BATCHES 16  // Batches per analysis thread read from the input at a time
+#define ANALYSIS_BLOCK_FRAMES ((ANALYSIS_BATCH - 1) * HOP_SIZE + WINDOW_SIZE)  // Frames one batch spans
+#define ADAPTIVE_HOPS 8      // Hops between the adaptive scheduler's coarse windows (so they just tile)
+#define ADAPTIVE_REGION (ANALYSIS_BATCH * ADAPTIVE_HOPS)  // Windows scheduled together (one coarse batch)
+#define ADAPTIVE_REGION_FRAMES ((ADAPTIVE_REGION - 1) * HOP_SIZE + WINDOW_SIZE)
+#define ADAPTIVE_MAX_CENTS 20.0f   // Coarse neighbours closer than this are one stable pitch
+#define ADAPTIVE_MAX_AMP_CHANGE 0.25f  // ... if their amplitudes are also within this fraction
+#define STREAM_BLOCK 4096    // Frames synthesized, processed and written per block
+#define SYNTH_BLOCK 64       // Frames the oscillator bank renders per kernel call
+#define CONTROL_BLOCK 32     // Frames between envelope/LFO evaluations (ramped in between)
+#define AMP_SCALE 200.0f
+#define AMP_THRESHOLD 0.05f  // Amplitude threshold for frequency updates
+#define AMP_SMOOTH 0.05f     // Amplitude smoothing factor (0-1)
+
+// Instrument types
+#define INSTR_PAD          0
+#define INSTR_PLUCK        1
+#define INSTR_BRASS        2
+#define INSTR_FLUTE        3
+#define INSTR_STRINGS      4
+#define INSTR_ORGAN        5
+#define INSTR_BELL         6
+#define INSTR_BASS         7
+#define INSTR_WURLITZER    8
+#define INSTR_ACID         9
+#define NUM_INSTRUMENTS    10
+
+// Reverb settings - the mix is set per reverb
+#define REVERB_MIX 0.4f       // Default mix of dry/wet (0.0 = dry, 1.0 = wet)
+#define REVERB_DECAY 0.8f     // Default feedback gain around the delay network (below 1.0)
+#define REVERB_DELAY1 1567    // Prime numbers work well for delays
+#define REVERB_DELAY2 2053
+#define REVERB_DELAY3 3001
+#define REVERB_DELAY4 4001
+#define MAX_REVERB_DELAY 4001 // Maximum delay length (must be largest of the above)
+#define REVERB_RING 4096      // Delay ring frames: a power of two above MAX_REVERB_DELAY
+#define REVERB_RING_MASK (REVERB_RING - 1)
+#define REVERB_CHUNK 256      // Frames processed together (must be under the shortest delay)
+
+// Wavetable settings
+#define WAVETABLE_SIZE_BITS 12
+#define WAVETABLE_SIZE (1 << WAVETABLE_SIZE_BITS)  // Samples per single-cycle table
+#define WAVETABLE_MAX_HARMONICS 1024 // Harmonics kept in the top mip level
+#define WAVETABLE_LEVELS 11          // Mip levels, one per octave (1024 harmonics down to 1)
+#define WAVETABLE_SLICES 9           // Brightness slices for brightness-dependent shapes
+
+// Pad synth settings
+#define NUM_OSCILLATORS 4      // Number of oscillators per voice
+#define DETUNE_AMOUNT 0.08f    // Detune amount in semitones
+#define ATTACK_TIME 0.3f       // Attack time in seconds
+#define RELEASE_TIME 0.5f      // Release time in seconds
+#define OCTAVE_MIX 0.3f        // Amount of lower octave to mix in (0.0 - 1.0)
+#define CHORUS_RATE 0.2f       // Chorus LFO rate in Hz
+#define CHORUS_DEPTH 0.5f      // Chorus depth (0.0 - 1.0)
+#define CHORUS_MIX 0.3f        // Chorus mix (0.0 - 1.0)
+#define CHORUS_DELAY 0.02f     // Chorus delay at the LFO's centre (seconds)
+#define CHORUS_SWEEP 0.01f     // Delay swing at full depth (seconds)
+#define CHORUS_MAX_DELAY 0.05f // Delay line length (must cover CHORUS_DELAY + CHORUS_SWEEP)
+
+// Instrument presets - these will be selected based on instrument type
+typedef struct {
+    int num_oscillators;     // Number of oscillators
+    float detune_amount;     // Detune amount in semitones
+    float attack_time;       // Attack time in seconds
+    float decay_time;        // Decay time in seconds
+    float sustain_level;     // Sustain level (0.0-1.0)
+    float release_time;      // Release time in seconds
+    float octave_mix;        // Amount of lower octave to mix in
+    float chorus_rate;       // Chorus LFO rate in Hz
+    float chorus_depth;      // Chorus depth (0.0-1.0)
+    float chorus_mix;        // Chorus mix (0.0-1.0)
+    float reverb_mix;        // Reverb mix (0.0-1.0)
+    float wave_blend;        // Blend between sine (0.0) and complex (1.0)
+    float brightness;        // Brightness factor (filter cutoff)
+    float harmonics;         // Harmonic content (0.0-1.0)
+    float tremolo_rate;      // Tremolo rate in Hz
+    float tremolo_depth;     // Tremolo depth (0.0-1.0)
+    float filter_mod;        // Filter modulation depth
+} InstrumentPreset;
+
+// Structure to store frequency data
+typedef struct {
+    float frequency;
+    float amplitude;
+} FrequencyPoint;
+
+// Instrument presets, indexed by INSTR_*, and their names
+extern const InstrumentPreset presets[];
+extern const char *instrument_names[];        // Display names ("Lush Pad", ...)
+extern const char *instrument_short_names[];  // Command line names ("pad", ...)
+
+// Waveforms (synth.c)
+float triangle_wave(float x);
+float pad_wave(float x, float blend);
+float soft_sine(float x);
+float square_wave(float x);
+float sawtooth_wave(float x);
+float noise(void);
+float bell_wave(float x, float harmonics);
+float harmonic_wave(float x, float harmonics);
+float pluck_wave(float x, float brightness);
+float acid_wave(float x, float cutoff, float resonance);
+float instrument_wave(float x, int instrument, float wave_blend, float brightness, float harmonics);
+float semitones_to_multiplier(float semitones);
+float adsr_envelope(float time, float attack, float decay, float sustain, float release, float note_length);
+int get_instrument_by_name(const char *name);
+
+// Band-limited wavetables - each instrument's waveform is sampled once at startup,
+// then a mip level per octave is made by dropping the harmonics that would alias.
+// Instruments whose tone follows the filter sweep get a stack of brightness slices.
+typedef struct {
+    int slices;             // Brightness slices (1 if the shape doesn't follow brightness)
+    int brightness_gain;    // Brightness only scales the output (acid) rather than the shape
+    float slice_low;        // Brightness of the first slice
+    float slice_step;       // Brightness step between slices
+    float *tables;          // [slice][level][WAVETABLE_SIZE + 1] (last sample repeats the first)
+} Wavetable;
+
+const Wavetable *wavetable_get(int instrument);
+
+// Oscillator bank - all of a voice's detuned oscillators, advanced together a block
+// at a time. Unused lanes have zero mix so the kernels can always run four wide.
+typedef struct {
+    float phase[4];         // Phase in cycles (0 to 1)
+    float ratio[4];         // Frequency ratio to the voice pitch (detune / sub-octave)
+    float mix[4];           // Output gain of each oscillator
+} OscBank;
+
+// Render `frames` samples of the summed oscillators. freq is the voice pitch and
+// brightness the filter-swept brightness, per sample.
+typedef void (*OscBankKernel)(OscBank *bank, const Wavetable *wt, const float *freq,
+                              const float *brightness, float *out, int frames, int samplerate);
+
+// Kernel names for --simd, in order of preference
+#define NUM_OSC_BANK_KERNELS 3
+extern const char *osc_bank_kernel_names[NUM_OSC_BANK_KERNELS];
+OscBankKernel osc_bank_select(const char *name);
+
+// Slowly changing synthesis controls, evaluated once per control block and
+// ramped linearly across it
+typedef struct {
+    float envelope;             // ADSR level
+    float chorus_mod;           // Chorus LFO (-depth to depth)
+    float filter_mod_amount;    // Filter sweep (scales brightness)
+    float tremolo_amount;       // Tremolo gain
+} ControlValues;
+
+// Chorus (effects.c): the dry signal goes into a short ring and comes back out at
+// a delay that moves frame by frame, read between samples by cubic interpolation
+typedef struct {
+    float *ring;
+    int mask;
+    unsigned position;          // Frames written so far
+    float mix;                  // Mix of dry/delayed (0.0 = dry)
+} Chorus;
+
+int chorus_init(Chorus *chorus, int samplerate, float mix);
+void chorus_free(Chorus *chorus);
+void chorus_process(Chorus *chorus, float *buffer, const float *delay, int frames);
+
+// Synthesis voice state, so the output can be rendered a block at a time
+typedef struct Synth Synth;
+
+// Renders a voice's next frames; one per instrument and oscillator kernel, with
+// the instrument's constants compiled in (see synth_render_select)
+typedef void (*SynthRenderKernel)(Synth *synth, float *out, int frames);
+
+struct Synth {
+    const InstrumentPreset *preset;
+    int instrument;
+    const Wavetable *wavetable;         // Band-limited tables for the instrument
+    const FrequencyPoint *freq_data;    // Pitch track, one point per hop
+    int freq_mask;                      // Window index mask (-1, or ring size - 1 when live)
+    int num_windows;                    // Windows available (grows when live)
+    sf_count_t total_frames;            // Length of the whole render (for the envelope)
+    int samplerate;
+    float freq_multiplier;              // Transposition
+    
+    sf_count_t position;                // Next frame to render
+    int window;                         // Analysis window that frame falls in
+    float current_frequency;            // Frequency at the start of the window
+    float next_frequency;               // Frequency at the end of the window
+    OscBank bank;                       // The detuned oscillators
+    OscBankKernel kernel;               // Scalar/SSE2/AVX2 oscillator bank kernel
+    SynthRenderKernel render;           // Synth loop specialised for the instrument and kernel
+    float chorus_phase;                 // Phase for chorus LFO
+    float filter_phase;                 // Phase for filter modulation
+    float tremolo_phase;                // Phase for tremolo
+    float chorus_lfo_rate;              // LFO phase increments per sample
+    float filter_lfo_rate;
+    float tremolo_lfo_rate;
+    float release_start;                // When the envelope's release begins (seconds)
+    float smooth_amp;
+    
+    // Control-rate state: controls are evaluated every control_block frames
+    // and ramped from `control_from` to `control_to` in between
+    int control_block;
+    int control_pos;                    // Frames into the current control block
+    float control_step;                 // 1 / control_block
+    ControlValues control_from;
+    ControlValues control_to;
+    
+    Chorus chorus;
+};
+
+int synth_init(Synth *synth, int instrument, const FrequencyPoint *freq_data, int num_windows,
+               sf_count_t total_frames, int samplerate, float freq_multiplier, OscBankKernel kernel,
+               int control_block);
+void synth_free(Synth *synth);
+SynthRenderKernel synth_render_select(int instrument, OscBankKernel kernel, const Wavetable *wt);
+void synth_render(Synth *synth, float *out, int frames);
+
+// Effects (effects.c)
+// Four-line feedback delay network reverb. The lines live in the Reverb so a long
+// signal can be fed through it one block at a time.
+typedef struct {
+    float ring[4][REVERB_RING];     // What went into each line, wrapped with REVERB_RING_MASK
+    int delay_lengths[4];
+    unsigned position;              // Frames written so far
+    float mix;                      // Mix of dry/wet (0.0 = dry, 1.0 = wet)
+    float decay;                    // Feedback gain (below 1.0)
+} Reverb;
+
+Reverb *reverb_create(float mix, float decay);
+void reverb_destroy(Reverb *reverb);
+void apply_reverb(Reverb *reverb, float *buffer, int length, int channels);
+
+// Single-tap echo with its delay line kept between blocks
+typedef struct {
+    int channels;
+    int delay;              // Frames
+    float gain_in;
+    float gain_out;
+    float decay;
+    float *ring;            // The last `delay` input frames
+    int position;           // Oldest frame in the ring (the one due back now)
+    int tail_done;          // Frames of tail given after the input ended
+} Echo;
+
+int echo_init(Echo *echo, int channels, int samplerate, float gain_in, float gain_out,
+              float delay_secs, float decay);
+void echo_free(Echo *echo);
+void echo_process(Echo *echo, float *buffer, int frames);
+int echo_tail(Echo *echo, float *out, int max_frames);
+
+// Look-ahead peak limiter: the output trails the input by `lookahead` frames
+typedef struct {
+    int channels;
+    int lookahead;          // Frames
+    float ceiling;          // Peak level the output is held under
+    float release;          // Per-frame release coefficient
+    float gain;             // Gain applied to the last frame out
+    float *delay;           // Input frames waiting to go out (lookahead of them)
+    float *held;            // Sliding minimum of the last `lookahead` frames (box averaged)
+    double held_sum;
+    sf_count_t *min_frame;  // Monotonic deque of (frame, target gain) for the sliding minimum
+    float *min_target;
+    int min_head;
+    int min_count;
+    sf_count_t frames_in;
+} Limiter;
+
+int limiter_init(Limiter *limiter, int channels, int samplerate, float ceiling, float lookahead_secs,
+                 float release_secs);
+void limiter_free(Limiter *limiter);
+int limiter_process(Limiter *limiter, const float *in, float *out, int frames);
+int limiter_flush(Limiter *limiter, float *out);
+
+// Memory-mapped input (wavmap.c)
+// An uncompressed WAV or RF64 file mapped read-only, so the analysis converts just
+// the channel and frames it needs, block by block, instead of decoding every channel
+typedef struct {
+    void *mapping;
+    size_t mapping_size;
+    const unsigned char *data;  // First frame
+    sf_count_t frames;
+    int channels;
+    int samplerate;
+    int bytes;                  // Bytes per sample (1-4, or 8 for double)
+    int is_float;
+    int frame_bytes;
+} WavMap;
+
+int wav_map_open(const char *path, WavMap *map);
+void wav_map_close(WavMap *map);
+const float *wav_map_floats(const WavMap *map);
+void wav_map_release(const WavMap *map, sf_count_t first, sf_count_t count);
+void wav_map_read_channel(const WavMap *map, int channel, sf_count_t first, int count, float *out);
+
+// Pitch analysis (analysis.c)
+// FFT analysis context - owns one batched plan and its aligned buffers for the whole
+// run, so the analysis doesn't pay for planning and allocation every hop
+typedef struct {
+    int n;                  // Transform size (samples per window)
+    int samplerate;         // Of the input, to turn bins into Hz
+    int howmany;            // Number of windows transformed per execution
+    int bins;               // Output bins per window (n/2 + 1)
+    int out_dist;           // Distance between spectra in out (bins padded to keep alignment)
+    int decimation;         // Input frames per transformed sample (1 at the full rate)
+    float *in;              // Aligned input buffer (howmany * n samples)
+    fftwf_complex *out;     // Aligned output buffer (howmany * out_dist bins)
+    float *mags;            // Magnitude scratch for the peak-pick (out_dist floats)
+    double *hann;           // Hann window, computed once
+    fftwf_plan plan;
+} FFTContext;
+
+// Planner rigour names, in the same order as planner_flags
+extern const char *planner_names[];
+extern const unsigned planner_flags[];
+
+// Held around every FFTW planner call, so tracks can be rendered on several threads
+extern pthread_mutex_t fftw_planner_lock;
+
+FFTContext *fft_context_create(int n, int howmany, int samplerate, unsigned flags);
+void fft_context_destroy(FFTContext *ctx);
+void analyze_windows(FFTContext *ctx, const float *samples, int stride, int hop, int count, FrequencyPoint *peaks);
+
+// A pitch engine turns hop windows into raw (frequency, amplitude) peaks. Window w
+// covers frames [w * hop, w * hop + WINDOW_SIZE); an engine may look at less of it
+// (lookahead() says how far in it reads, which is what live input waits for), but
+// every engine gives one point per window so pitch tracks line up. The hop is
+// HOP_SIZE, or up to ADAPTIVE_HOPS times that for the adaptive scheduler's coarse pass.
+// Amplitudes are on the peak picker's scale, so AMP_SCALE/AMP_THRESHOLD apply to all.
+// Each analysis thread gets its own state from create(), which transforms up to
+// `batch` windows at a time (ANALYSIS_BATCH for files, fewer for live input).
+// An engine may also read up to ANALYSIS_GUARD frames either side of the windows it
+// is given: `before` and `after` say how many real frames lie before the first
+// window and past the end of the last (fewer only at the ends of the input), and
+// anything beyond them counts as silence. So a window's point doesn't depend on
+// how the windows were batched.
+#define ANALYSIS_GUARD (DECIMATE_HALF_TAPS * HOP_SIZE)  // The decimation filter's reach at its widest
+typedef struct {
+    const char *name;           // For --pitch-engine
+    int id;                     // Recorded in pitch track sidecars
+    void *(*create)(int samplerate, int batch, unsigned planner_flags);
+    void (*destroy)(void *state);
+    void (*analyze)(void *state, const float *samples, int stride, int hop, int count, int before, int after,
+                    FrequencyPoint *peaks);
+    int (*lookahead)(int samplerate);   // Frames from a window's start to past the last it reads
+} PitchEngine;
+
+extern const PitchEngine pitch_engines[];
+extern const int num_pitch_engines;
+const PitchEngine *pitch_engine_find(const char *name);
+
+// Every analysis thread has an engine state made for ANALYSIS_BATCH windows. With
+// adaptive hops it also has a fine state, made for ADAPTIVE_HOPS - 1 windows, and
+// `analysed` counts the windows the engine actually looked at.
+int default_thread_count(void);
+int analyze_file(SNDFILE *infile, const SF_INFO *sfinfo, const PitchEngine *engine, void **states,
+                 void **fine_states, int num_threads, int num_windows, int voices, FrequencyPoint *peaks,
+                 int *analysed);
+int analyze_mapped(const WavMap *map, const PitchEngine *engine, void **states, void **fine_states,
+                   int num_threads, int num_windows, int voices, FrequencyPoint *peaks, int *analysed);
+void resolve_pitch_track(FrequencyPoint *freq_data, int num_windows);
+
+// Incremental pitch tracking for live input: push one channel's samples as they
+// arrive, pull resolved points hop by hop. Only the frames the next windows need
+// are held, so memory doesn't grow with the input.
+typedef struct {
+    const PitchEngine *engine;
+    void *state;
+    float *samples;             // Pushed frames still needed: `before` ahead of the next window, then its own
+    int before;                 // Up to ANALYSIS_GUARD
+    int filled;
+    int capacity;               // ANALYSIS_GUARD + lookahead + batch * HOP_SIZE
+    int lookahead;              // Frames a window needs before it can be analysed
+    float last_valid_frequency; // Carried forward through quiet windows
+    long long windows;          // Points pulled so far
+} PitchTracker;
+
+int pitch_tracker_init(PitchTracker *tracker, const PitchEngine *engine, int samplerate, int batch,
+                       unsigned planner_flags);
+void pitch_tracker_free(PitchTracker *tracker);
+int pitch_tracker_push(PitchTracker *tracker, const float *samples, int stride, int count);
+int pitch_tracker_pull(PitchTracker *tracker, FrequencyPoint *points, int max_points);
+int pitch_tracker_finish(PitchTracker *tracker, FrequencyPoint *points, int max_points);
+
+// YIN pitch engine (yin.c)
+int yin_engine_lookahead(int samplerate);
+void *yin_engine_create(int samplerate, int batch, unsigned planner_flags);
+void yin_engine_destroy(void *state);
+void yin_engine_analyze(void *state, const float *samples, int stride, int hop, int count, int before, int after,
+                        FrequencyPoint *peaks);
+
+// Decimated peak engine (decimate.c): channel 0 is low-pass filtered and decimated
+// to just above the pitch range, so the peak-pick runs on far smaller transforms
+// with the same bin spacing
+#define DECIMATE_MIN_RATE (3.0f * MAX_FREQUENCY)  // Lowest decimated rate (keeps aliases above MAX_FREQUENCY)
+#define DECIMATE_HALF_TAPS 6        // Decimated samples each side of an output the filter spans
+#define DECIMATE_KAISER_BETA 7.0    // Window shape: about 70 dB of stopband
+
+int decimation_factor(int samplerate);
+int decimated_engine_lookahead(int samplerate);
+void *decimated_engine_create(int samplerate, int batch, unsigned planner_flags);
+void decimated_engine_destroy(void *state);
+void decimated_engine_analyze(void *state, const float *samples, int stride, int hop, int count, int before,
+                              int after, FrequencyPoint *peaks);
+
+// Rendering a file (render.c)
+
+// Everything that picks how a track is rendered
+typedef struct {
+    int instrument;             // INSTR_*
+    float transpose;            // Transposition in semitones
+    float volume;               // Output volume multiplier
+    int threads;                // Pitch analysis threads
+    unsigned fft_planner;       // FFTW planner flags
+    const char *wisdom_file;    // FFTW wisdom cache (NULL for none)
+    OscBankKernel kernel;       // Oscillator bank kernel
+    int control_block;          // Frames between envelope/LFO updates
+    int pitch_cache;            // Reuse (and write) the input's pitch track sidecar
+    int adaptive_hop;           // Analyse stable stretches at a coarser hop and interpolate them
+    int per_channel;            // A pitch track and voice per input channel (else channel 0's on all)
+    const PitchEngine *pitch_engine;
+} RenderOptions;
+
+// The resolved pitch track of an input file, plus the input's format. With
+// per-channel analysis there's a track per channel, one after another.
+typedef struct {
+    FrequencyPoint *points;     // One point per hop, per voice ([voice][window])
+    int num_windows;
+    int voices;                 // Tracks in points: 1, or one per channel
+    sf_count_t frames;
+    int samplerate;
+    int channels;
+    void *mapping;              // Mapped sidecar the points live in (NULL if malloc'd)
+    size_t mapping_size;
+} PitchTrack;
+
+// Helper threads that synthesize a renderer's voices side by side, a block at a
+// time. Voice v is rendered by thread v % (num_threads + 1); the calling thread
+// is thread 0 and takes its share too.
+typedef struct {
+    pthread_t *threads;
+    int num_threads;            // Helpers
+    int profile_track;          // Track the helpers' work is profiled against
+    pthread_mutex_t lock;
+    pthread_cond_t start;       // A block has been handed out
+    pthread_cond_t done;        // A helper has finished its voices
+    unsigned generation;        // Blocks handed out so far
+    int pending;                // Helpers still on the current block
+    int frames;                 // Frames in the current block
+    int joined;                 // Helpers that have taken a thread number
+    int quit;
+} VoicePool;
+
+// Turns a pitch track into finished audio (synth, reverb, volume) a block at a time.
+// With a track per channel each channel has its own voice, synthesized into its
+// own plane and interleaved; otherwise the one voice goes to every channel.
+typedef struct {
+    Synth *synths;              // One per voice
+    int voices;
+    Reverb *reverb;
+    float volume;
+    int channels;
+    sf_count_t frames;          // Length of the whole render
+    float *planar;              // One STREAM_BLOCK of synth output per voice
+    VoicePool pool;             // Helpers (none for a single voice or a single thread)
+} Renderer;
+
+// A whole interleaved signal held in memory
+typedef struct {
+    float *samples;
+    sf_count_t frames;
+    int channels;
+    int samplerate;
+} AudioBuffer;
+
+void render_options_init(RenderOptions *options);
+int pitch_track_analyze(const char *input_file, const RenderOptions *options, PitchTrack *track);
+void pitch_track_free(PitchTrack *track);
+int renderer_init(Renderer *renderer, const PitchTrack *track, const RenderOptions *options);
+int renderer_render(Renderer *renderer, float *out, int max_frames);
+void renderer_free(Renderer *renderer);
+int render_file(const char *input_file, const RenderOptions *options, AudioBuffer *out);
+
+// Live rendering (live.c)
+#define LIVE_ANALYSIS_BATCH 4       // Windows per FFT execution: analyse each hop as it arrives
+#define LIVE_POINTS 256             // Ring of pitch points kept by a live renderer (power of two)
+
+// Renders input as it arrives rather than from a whole file. Written frames are
+// pitch tracked hop by hop and the synth runs as far as the points so far allow:
+// frame t glides towards the point of the window after its own, which is ready
+// once frame t + live_renderer_latency() or so has been written (one hop plus the
+// engine's lookahead). Synth, chorus and reverb
+// state carry on from block to block. The note is held until finish(), which
+// releases it from the output so far and renders the release tail past the input.
+typedef struct {
+    RenderOptions options;
+    PitchTracker tracker;
+    FrequencyPoint points[LIVE_POINTS]; // Ring of the newest points
+    int num_points;                     // Points tracked so far
+    Renderer renderer;
+    int started;                        // Renderer set up (it needs the first two points)
+    int finished;                       // No more input; render up to frames_in
+    int samplerate;
+    int channels;
+    sf_count_t frames_in;               // Frames written so far
+    sf_count_t frames_out;              // Frames read back so far
+} LiveRenderer;
+
+int live_renderer_init(LiveRenderer *live, const RenderOptions *options, int samplerate, int channels);
+int live_renderer_write(LiveRenderer *live, const float *in, int frames);
+int live_renderer_read(LiveRenderer *live, float *out, int max_frames);
+void live_renderer_finish(LiveRenderer *live);
+void live_renderer_free(LiveRenderer *live);
+int live_renderer_latency(const LiveRenderer *live);
+
+// Buffers and mixing (mix.c)
+int audio_buffer_alloc(AudioBuffer *buffer, sf_count_t frames, int channels, int samplerate);
+void audio_buffer_free(AudioBuffer *buffer);
+int audio_buffer_read(const char *path, AudioBuffer *buffer);
+int audio_buffer_write(const char *path, const AudioBuffer *buffer);
+double bessel_i0(double x);
+void mix_block_add(float *bus, int channels, const float *track, int track_channels, int frames, float gain);
+
+// Polyphase resampler: a Kaiser-windowed sinc, one set of taps per output phase,
+// fed a block at a time. Equal rates pass straight through.
+#define RESAMPLE_HALF_TAPS 16       // Input frames each side of an output (at the narrower band)
+#define RESAMPLE_MAX_PHASES 1024    // Ratios needing more phases round to the nearest of these
+#define RESAMPLE_ROLLOFF 0.94f      // Cutoff, as a fraction of the lower of the two Nyquists
+#define RESAMPLE_KAISER_BETA 8.6f   // Window shape: about 90 dB of stopband
+
+typedef struct {
+    int channels;
+    int up;                 // Output rate / input rate, in lowest terms
+    int down;
+    int phases;             // Tap sets in coeffs (up, unless that's over RESAMPLE_MAX_PHASES)
+    int half;               // Input frames used each side of an output position
+    int taps;               // 2 * half
+    float *coeffs;          // [phases][taps]
+    float *history;         // Input frames from `base` on (interleaved)
+    int capacity;           // Frames history holds
+    int filled;             // Frames in it
+    sf_count_t base;        // Input frame history[0] is (negative: leading silence)
+    sf_count_t next;        // Next output frame
+    sf_count_t frames_in;   // Input frames fed in
+} Resampler;
+
+int resampler_init(Resampler *resampler, int in_rate, int out_rate, int channels);
+void resampler_free(Resampler *resampler);
+int resampler_max_output(const Resampler *resampler, int frames);
+int resampler_process(Resampler *resampler, const float *in, int frames, float *out);
+int resampler_flush(Resampler *resampler, float *out, int max_frames);
+sf_count_t resampler_output_frames(const Resampler *resampler, sf_count_t in_frames);
+
+// Caches (cache.c)
+
+// FNV-1a, 64 bit: a running hash fed a piece at a time, starting from FNV_OFFSET
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+uint64_t fnv1a(uint64_t hash, const void *data, size_t length);
+int hash_file(const char *path, uint64_t *hash);
+int source_key(const char *path, uint64_t *key);
+
+// A directory of rendered audio named by the hash of everything that went into it.
+// Entries are touched when used and the least recently used go first once the
+// directory is over max_bytes.
+typedef struct {
+    char dir[256];
+    long long max_bytes;
+} RenderCache;
+
+// An entry being written a block at a time
+typedef struct {
+    SNDFILE *file;
+    char path[512];
+    char temp[560];
+} RenderCacheWriter;
+
+int render_cache_open(RenderCache *cache, const char *dir, long long max_bytes);
+SNDFILE *render_cache_read(const RenderCache *cache, uint64_t key, SF_INFO *info);
+int render_cache_begin(const RenderCache *cache, uint64_t key, int channels, int samplerate,
+                       RenderCacheWriter *writer);
+int render_cache_write(RenderCacheWriter *writer, const float *samples, int frames);
+int render_cache_commit(RenderCacheWriter *writer);
+void render_cache_abort(RenderCacheWriter *writer);
+void render_cache_evict(const RenderCache *cache);
+
+// Pitch track sidecar: <input>.wpt next to the input, holding its resolved pitch
+// track. It's only used if every analysis setting still matches and the input is
+// the same: its source_key matches, or failing that (a touched or copied input) its
+// hash does. Native byte order; the header is a multiple of 8 bytes so the points
+// stay aligned.
+#define PITCH_TRACK_MAGIC "WPT\0"
+#define PITCH_TRACK_VERSION 4
+#define SOURCE_KEY_BLOCK 65536      // Bytes at each end of the input its source_key covers
+#define PITCH_TRACK_EXTENSION ".wpt"
+#define PITCH_TRACK_ADAPTIVE 1      // Stable stretches were interpolated (adaptive hop)
+#define PITCH_TRACK_PER_CHANNEL 2   // A track per channel rather than channel 0's alone
+
+typedef struct {
+    char magic[4];              // PITCH_TRACK_MAGIC
+    uint32_t version;           // PITCH_TRACK_VERSION
+    uint32_t byte_order;        // 0x01020304 as written
+    uint32_t window_size;       // WINDOW_SIZE
+    uint32_t hop_size;          // HOP_SIZE
+    uint32_t engine;            // PitchEngine id
+    uint32_t flags;             // PITCH_TRACK_* flags (zero for every window analysed)
+    float min_frequency;        // MIN_FREQUENCY
+    float max_frequency;        // MAX_FREQUENCY
+    float amp_threshold;        // AMP_THRESHOLD
+    float amp_scale;            // AMP_SCALE
+    uint32_t num_windows;
+    uint64_t source_hash;       // hash_file of the input
+    uint64_t source_key;        // source_key of the input
+    int64_t frames;             // Input format
+    int32_t samplerate;
+    int32_t channels;
+} PitchTrackHeader;
+
+void pitch_track_sidecar_path(const char *input_file, char *path, size_t size);
+int pitch_track_load(const char *path, const char *input_file, int engine, uint32_t flags, PitchTrack *track);
+int pitch_track_save(const char *path, uint64_t source_key, uint64_t source_hash, int engine, uint32_t flags,
+                     const PitchTrack *track);
+
+// Profiling (profile.c)
+// Pipeline stages time and allocations are counted against, per track
+#define PROFILE_SETUP      0    // Planning, allocating and opening, before any audio flows
+#define PROFILE_CACHE      1    // Hashing inputs, pitch track sidecars, cache upkeep
+#define PROFILE_DECODE     2    // Reading input and converting it to float
+#define PROFILE_ANALYSIS   3    // Pitch engine and resolving the track
+#define PROFILE_SYNTH      4    // Controls and oscillator bank
+#define PROFILE_CHORUS     5
+#define PROFILE_REVERB     6
+#define PROFILE_VOLUME     7    // Copy to every channel and volume
+#define PROFILE_RESAMPLE   8
+#define PROFILE_ECHO       9
+#define PROFILE_MIX        10
+#define PROFILE_LIMITER    11
+#define PROFILE_ENCODE     12   // Converting and writing output (and cache entries)
+#define PROFILE_STAGES     13
+
+extern const char *profile_stage_names[];
+extern int profile_enabled;     // Set by profile_init; spans cost one branch without it
+
+int profile_init(const char *tool, int num_tracks, int trace);
+void profile_free(void);
+void profile_set_track_name(int track, const char *name);
+void profile_set_track(int track);
+int profile_get_track(void);
+int64_t profile_now(void);
+int64_t profile_begin(void);
+void profile_end(int stage, int64_t start);
+void profile_add(int stage, int64_t ns, int64_t calls);
+void profile_alloc(int stage, size_t bytes);
+int profile_write(const char *report_path, const char *trace_path);
+
+#endif
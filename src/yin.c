@@ -0,0 +1,217 @@
+// yin.c - YIN pitch engine (de Cheveigné & Kawahara), with the difference function
+// worked out through FFT cross-correlation and the dip refined by parabolic interpolation
+#include "whistler.h"
+
+#define YIN_THRESHOLD 0.15f     // First dip of the normalised difference below this wins
+#define YIN_UNVOICED 0.35f      // If no dip gets under the threshold, the best must beat this
+
+// Per-thread YIN state. Each frame is x = `length` samples centred in its hop window;
+// its difference function compares the first `integration` samples with x shifted by
+// every lag up to max_lag.
+typedef struct {
+    int samplerate;
+    int howmany;            // Frames transformed per execution
+    int min_lag;            // Shortest period considered (MAX_FREQUENCY)
+    int max_lag;            // Longest period considered (MIN_FREQUENCY)
+    int integration;        // Samples compared at each lag
+    int length;             // Samples per frame (integration + max_lag)
+    int offset;             // Where the frame starts in its hop window
+    int n;                  // Transform size (power of two >= length)
+    int bins;               // n/2 + 1
+    int spec_dist;          // Distance between spectra (bins padded to keep alignment)
+    float *in;              // [frame][x, head of x] - 2 * howmany rows of n samples
+    fftwf_complex *spec;    // Spectra of the rows above
+    float *corr;            // howmany cross-correlations of n samples
+    float *cmnd;            // Cumulative mean normalised difference, lags 0 to max_lag
+    fftwf_plan forward;
+    fftwf_plan inverse;
+} YinContext;
+
+void yin_engine_destroy(void *state) {
+    YinContext *yin = (YinContext*)state;
+    if (!yin) return;
+    pthread_mutex_lock(&fftw_planner_lock);
+    if (yin->forward) fftwf_destroy_plan(yin->forward);
+    if (yin->inverse) fftwf_destroy_plan(yin->inverse);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    fftwf_free(yin->in);
+    fftwf_free(yin->spec);
+    fftwf_free(yin->corr);
+    free(yin->cmnd);
+    free(yin);
+}
+
+// Lay out the frame for a sample rate: the lags searched and where in its hop
+// window the frame sits. Integrating over one longest period is enough to see it,
+// and keeps the frame (and so the transforms) around half the peak picker's
+// window. The frame is centred on the window's centre, so its points describe the
+// same moment as the peak picker's.
+static void yin_layout(YinContext *yin, int samplerate) {
+    yin->samplerate = samplerate;
+    yin->min_lag = (int)(samplerate / MAX_FREQUENCY);
+    yin->max_lag = (int)ceilf(samplerate / MIN_FREQUENCY) + 1;
+    if (yin->min_lag < 2) yin->min_lag = 2;
+    if (yin->max_lag > WINDOW_SIZE / 2) yin->max_lag = WINDOW_SIZE / 2;  // Very high sample rates
+    yin->integration = yin->max_lag;
+    yin->length = yin->integration + yin->max_lag;
+    yin->offset = (WINDOW_SIZE - yin->length) / 2;
+}
+
+// Nothing after the frame is read, so live input only waits for the frame's end
+// (734 frames of a 1024-frame window at 44.1 kHz)
+int yin_engine_lookahead(int samplerate) {
+    YinContext layout;
+    yin_layout(&layout, samplerate);
+    return layout.offset + layout.length;
+}
+
+void *yin_engine_create(int samplerate, int batch, unsigned planner_flags) {
+    YinContext *yin = (YinContext*)calloc(1, sizeof(YinContext));
+    if (!yin) return NULL;
+
+    yin->howmany = batch;
+    yin_layout(yin, samplerate);
+    yin->n = 1;
+    while (yin->n < yin->length) yin->n <<= 1;
+    yin->bins = yin->n / 2 + 1;
+    yin->spec_dist = (yin->bins + 1) & ~1;
+
+    int rows = 2 * yin->howmany;
+    yin->in = (float*) fftwf_malloc(sizeof(float) * yin->n * rows);
+    yin->spec = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * yin->spec_dist * rows);
+    yin->corr = (float*) fftwf_malloc(sizeof(float) * yin->n * yin->howmany);
+    yin->cmnd = (float*) malloc(sizeof(float) * (yin->max_lag + 1));
+    profile_alloc(PROFILE_ANALYSIS, sizeof(YinContext) + sizeof(float) * yin->n * rows +
+                  sizeof(fftwf_complex) * yin->spec_dist * rows + sizeof(float) * yin->n * yin->howmany +
+                  sizeof(float) * (yin->max_lag + 1));
+    if (!yin->in || !yin->spec || !yin->corr || !yin->cmnd) {
+        yin_engine_destroy(yin);
+        return NULL;
+    }
+
+    // Forward: every row. Inverse: the product spectra, which overwrite each frame's
+    // own spectrum (every other row).
+    int n = yin->n;
+    pthread_mutex_lock(&fftw_planner_lock);
+    yin->forward = fftwf_plan_many_dft_r2c(1, &n, rows,
+                                           yin->in, NULL, 1, n,
+                                           yin->spec, NULL, 1, yin->spec_dist,
+                                           planner_flags);
+    yin->inverse = fftwf_plan_many_dft_c2r(1, &n, yin->howmany,
+                                           yin->spec, NULL, 1, 2 * yin->spec_dist,
+                                           yin->corr, NULL, 1, n,
+                                           planner_flags);
+    pthread_mutex_unlock(&fftw_planner_lock);
+    if (!yin->forward || !yin->inverse) {
+        yin_engine_destroy(yin);
+        return NULL;
+    }
+    return yin;
+}
+
+// Pick the period of one frame from its cross-correlation. Returns 0 Hz if unvoiced.
+static float yin_pick(YinContext *yin, const float *x, const float *corr, float *energy) {
+    int integration = yin->integration;
+    int max_lag = yin->max_lag;
+    float *cmnd = yin->cmnd;
+    float scale = 1.0f / yin->n;  // c2r is unnormalised
+
+    // d(lag) = sum (x[j] - x[j + lag])^2 over the integration window
+    //        = energy of the head + energy of the shifted window - 2 * correlation
+    float head = 0.0f;
+    for (int j = 0; j < integration; j++) head += x[j] * x[j];
+    *energy = head;
+
+    float shifted = head;
+    float running = 0.0f;
+    cmnd[0] = 1.0f;
+    for (int lag = 1; lag <= max_lag; lag++) {
+        shifted += x[lag + integration - 1] * x[lag + integration - 1] - x[lag - 1] * x[lag - 1];
+        float d = head + shifted - 2.0f * corr[lag] * scale;
+        if (d < 0.0f) d = 0.0f;  // Rounding
+        running += d;
+        cmnd[lag] = running > 0.0f ? d * lag / running : 1.0f;
+    }
+
+    // First dip under the threshold (followed down to its bottom), or else the deepest
+    int best = 0;
+    for (int lag = yin->min_lag; lag <= max_lag; lag++) {
+        if (cmnd[lag] < YIN_THRESHOLD) {
+            while (lag + 1 <= max_lag && cmnd[lag + 1] < cmnd[lag]) lag++;
+            best = lag;
+            break;
+        }
+    }
+    if (!best) {
+        best = yin->min_lag;
+        for (int lag = yin->min_lag + 1; lag <= max_lag; lag++) {
+            if (cmnd[lag] < cmnd[best]) best = lag;
+        }
+        if (cmnd[best] >= YIN_UNVOICED) return 0.0f;
+    }
+
+    // Parabola through the dip and its neighbours for a sub-sample period
+    float period = (float)best;
+    if (best > yin->min_lag && best < max_lag) {
+        float a = cmnd[best - 1];
+        float b = cmnd[best];
+        float c = cmnd[best + 1];
+        float curvature = a - 2.0f * b + c;
+        if (curvature > 0.0f) {
+            period += 0.5f * (a - c) / curvature;
+        }
+    }
+    return yin->samplerate / period;
+}
+
+// Analyse `count` consecutive hop windows (laid out as for the peak picker); the
+// frames read all lie inside them, so nothing before or after is needed
+void yin_engine_analyze(void *state, const float *samples, int stride, int hop, int count, int before, int after,
+                        FrequencyPoint *peaks) {
+    YinContext *yin = (YinContext*)state;
+    (void)before;
+    (void)after;
+    int n = yin->n;
+
+    // A pure tone's RMS times this matches the peak picker's Hann-windowed bin magnitude
+    float amplitude_scale = sqrtf(2.0f) * WINDOW_SIZE / 4.0f;
+
+    for (int first = 0; first < count; first += yin->howmany) {
+        int batch = count - first < yin->howmany ? count - first : yin->howmany;
+
+        // Each frame, then its head alone, both zero-padded to the transform size
+        memset(yin->in, 0, sizeof(float) * n * 2 * yin->howmany);
+        for (int b = 0; b < batch; b++) {
+            const float *src = samples + ((sf_count_t)(first + b) * hop + yin->offset) * stride;
+            float *x = yin->in + (sf_count_t)2 * b * n;
+            float *head = x + n;
+            for (int i = 0; i < yin->length; i++) {
+                x[i] = src[(sf_count_t)i * stride];
+            }
+            memcpy(head, x, sizeof(float) * yin->integration);
+        }
+        fftwf_execute(yin->forward);
+
+        // Cross-correlation of head with frame: X * conj(H)
+        for (int b = 0; b < batch; b++) {
+            fftwf_complex *x = yin->spec + (sf_count_t)2 * b * yin->spec_dist;
+            const fftwf_complex *h = x + yin->spec_dist;
+            for (int k = 0; k < yin->bins; k++) {
+                float re = x[k][0] * h[k][0] + x[k][1] * h[k][1];
+                float im = x[k][1] * h[k][0] - x[k][0] * h[k][1];
+                x[k][0] = re;
+                x[k][1] = im;
+            }
+        }
+        fftwf_execute(yin->inverse);
+
+        for (int b = 0; b < batch; b++) {
+            float energy;
+            const float *x = yin->in + (sf_count_t)2 * b * n;
+            // The forward transform leaves its input alone, so x is still the frame
+            float frequency = yin_pick(yin, x, yin->corr + (sf_count_t)b * n, &energy);
+            peaks[first + b].frequency = frequency;
+            peaks[first + b].amplitude = sqrtf(energy / yin->integration) * amplitude_scale;
+        }
+    }
+}